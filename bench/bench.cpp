@@ -0,0 +1,912 @@
+// Microbenchmarks for every stage of the calculator pipeline.
+//
+//   bin/bench [--depth N] [--mix DEC:HEX:BIN] [--vars N] [--sessions N]
+//             [--exprs N] [--repeat PERCENT] [--malformed PERCENT] [--seed N]
+//             [--min-time SECONDS] [--filter NAME] [--json FILE] [--baseline FILE]
+//
+// Each stage is timed on its own over a synthetic workload and reported as
+// ns/op, throughput and heap allocations per op. --json writes the results
+// in a machine-readable form; --baseline compares against such a file.
+// The math kernel stages also print a table of each tier's largest error
+// in ulp next to its time per value.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "workload.h"
+#include "lexer.h"
+#include "parser.h"
+#include "evaluator.h"
+#include "bytecode.h"
+#include "optimizer.h"
+#include "jit.h"
+#include "session.h"
+#include "compiledFile.h"
+#include "mappedFile.h"
+#include "stats.h"
+#include "utils.h"
+#include "mathKernels.h"
+#include "constexprCalc.h"
+#include "engine.h"
+
+// Keep 'value', and the work that produced it, from being optimized away
+template <typename T>
+static inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "g"(value) : "memory");
+}
+
+// What an error line cost before errors were returned as values: its
+// message in a std::runtime_error, thrown and caught
+[[gnu::noinline]] static void throwError(std::string_view message)
+{
+    throw std::runtime_error(std::string(message));
+}
+
+// --------------------------------------
+// Allocation counting
+// --------------------------------------
+static std::atomic<uint64_t> allocationCount{0};
+
+void *operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// --------------------------------------
+// Harness
+// --------------------------------------
+struct Work
+{
+    uint64_t ops;  // operations done in one pass
+    double units;  // bytes or items processed in one pass
+};
+
+struct BenchResult
+{
+    std::string name;
+    double nsPerOp;
+    double throughput;
+    std::string unit; // "MB/s" or "ops/s"
+    double allocsPerOp;
+    uint64_t ops;
+};
+
+static double minSeconds = 0.3;
+
+// Run 'pass' until at least minSeconds have elapsed (after one warm-up pass)
+template <typename Pass>
+static BenchResult measure(const std::string &name, bool bytes, Pass pass)
+{
+    using Clock = std::chrono::steady_clock;
+    pass();
+
+    uint64_t ops = 0;
+    double units = 0;
+    uint64_t allocationsBefore = allocationCount.load();
+    auto start = Clock::now();
+    double elapsed = 0;
+    do
+    {
+        Work w = pass();
+        ops += w.ops;
+        units += w.units;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    uint64_t allocations = allocationCount.load() - allocationsBefore;
+
+    BenchResult r;
+    r.name = name;
+    r.nsPerOp = elapsed * 1e9 / static_cast<double>(ops);
+    r.throughput = bytes ? units / elapsed / 1e6 : units / elapsed;
+    r.unit = bytes ? "MB/s" : "ops/s";
+    r.allocsPerOp = static_cast<double>(allocations) / static_cast<double>(ops);
+    r.ops = ops;
+    return r;
+}
+
+// --------------------------------------
+// Math kernels
+// --------------------------------------
+
+// Inputs for one function of mathKernels.h, with the exact values in long
+// double (64-bit mantissa, so the measured error is good to ~0.001 ulp)
+struct MathCase
+{
+    const char *name;
+    std::vector<double> x, y;
+    std::vector<long double> exact;
+};
+
+static std::vector<MathCase> mathCases(uint64_t seed)
+{
+    const size_t count = 1 << 14;
+    std::mt19937_64 rng(seed);
+    auto uniform = [&](double low, double high)
+    { return std::uniform_real_distribution<double>(low, high)(rng); };
+
+    std::vector<MathCase> cases = {{"sin", {}, {}, {}}, {"cos", {}, {}, {}}, {"exp", {}, {}, {}},
+                                   {"log", {}, {}, {}}, {"pow", {}, {}, {}}};
+    for (size_t i = 0; i < count; i++)
+    {
+        // Mostly moderate arguments, some far from zero
+        double angle = i % 8 ? uniform(-10, 10) : uniform(-1e5, 1e5);
+        cases[0].x.push_back(angle);
+        cases[0].exact.push_back(sinl(angle));
+        cases[1].x.push_back(angle);
+        cases[1].exact.push_back(cosl(angle));
+
+        double e = uniform(-700, 709);
+        cases[2].x.push_back(e);
+        cases[2].exact.push_back(expl(e));
+
+        double l = std::exp2(uniform(-1000, 1000));
+        cases[3].x.push_back(l);
+        cases[3].exact.push_back(logl(l));
+
+        // Every other pair with |y log x| up to 700
+        double base = uniform(0.01, 10);
+        double exponent = i % 2 ? uniform(-20, 20) : uniform(-700, 700) / std::log(base);
+        cases[4].x.push_back(base);
+        cases[4].y.push_back(exponent);
+        cases[4].exact.push_back(powl(base, exponent));
+    }
+    return cases;
+}
+
+static void runMathKernel(const math::Kernels &kernels, const MathCase &c, std::vector<double> &a)
+{
+    a = c.x;
+    if (c.name[0] == 's')
+        kernels.sin(a.data(), a.size());
+    else if (c.name[0] == 'c')
+        kernels.cos(a.data(), a.size());
+    else if (c.name[0] == 'e')
+        kernels.exp(a.data(), a.size());
+    else if (c.name[0] == 'l')
+        kernels.log(a.data(), a.size());
+    else
+        kernels.pow(a.data(), c.y.data(), a.size());
+}
+
+// Distance from the exact value in units of the last place of the result
+static double ulpError(double value, long double exact)
+{
+    double rounded = static_cast<double>(exact);
+    if (std::isnan(value) || std::isnan(rounded) || std::isinf(value) || std::isinf(rounded) || rounded == 0)
+        return value == rounded || (std::isnan(value) && std::isnan(rounded)) ? 0 : INFINITY;
+    int exponent;
+    std::frexp(rounded, &exponent);
+    double ulp = std::ldexp(1.0, std::max(exponent, -1021) - 53);
+    return static_cast<double>(fabsl(value - exact) / ulp);
+}
+
+// The formula of the formula/ stages; FIXED_FORMULA(_expr) is its
+// constexprCalc.h literal
+#define FIXED_FORMULA(suffix) "(x * 0x10 + y) ^ 2 / (y + 0b11) - x * 1.5" ## suffix
+
+// Pull "key": value out of one line of a results file
+static bool jsonField(const std::string &line, const std::string &key, std::string &value)
+{
+    size_t p = line.find("\"" + key + "\":");
+    if (p == std::string::npos)
+        return false;
+    p += key.size() + 3;
+    while (p < line.size() && line[p] == ' ')
+        p++;
+    if (p < line.size() && line[p] == '"')
+    {
+        size_t end = line.find('"', p + 1);
+        value = line.substr(p + 1, end - p - 1);
+    }
+    else
+    {
+        size_t end = line.find_first_of(",}", p);
+        value = line.substr(p, end - p);
+    }
+    return true;
+}
+
+static std::vector<BenchResult> loadBaseline(const std::string &filename)
+{
+    std::vector<BenchResult> results;
+    std::ifstream in(filename);
+    std::string line, value;
+    while (std::getline(in, line))
+    {
+        BenchResult r{};
+        if (!jsonField(line, "name", r.name))
+            continue;
+        if (jsonField(line, "ns_per_op", value))
+            r.nsPerOp = std::atof(value.c_str());
+        if (jsonField(line, "allocs_per_op", value))
+            r.allocsPerOp = std::atof(value.c_str());
+        results.push_back(r);
+    }
+    return results;
+}
+
+static void writeJson(std::ostream &out, const WorkloadConfig &config, const std::vector<BenchResult> &results)
+{
+    out << "{\n  \"config\": {\"depth\": " << config.depth
+        << ", \"mix\": \"" << config.decimalWeight << ":" << config.hexWeight << ":" << config.binaryWeight
+        << "\", \"vars\": " << config.variables
+        << ", \"sessions\": " << config.sessions
+        << ", \"exprs\": " << config.expressionsPerSession
+        << ", \"repeat\": " << config.repeat
+        << ", \"seed\": " << config.seed << "},\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"ns_per_op\": " << r.nsPerOp
+            << ", \"throughput\": " << r.throughput << ", \"throughput_unit\": \"" << r.unit
+            << "\", \"allocs_per_op\": " << r.allocsPerOp << ", \"ops\": " << r.ops << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// --------------------------------------
+// Benchmarks
+// --------------------------------------
+int main(int argc, char *argv[])
+{
+    WorkloadConfig config;
+    std::string jsonFile, baselineFile, filter;
+    int malformedPercent = 30;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string
+        { return i + 1 < argc ? argv[++i] : ""; };
+
+        if (arg == "--depth")
+            config.depth = std::atoi(next().c_str());
+        else if (arg == "--mix")
+            std::sscanf(next().c_str(), "%d:%d:%d", &config.decimalWeight, &config.hexWeight, &config.binaryWeight);
+        else if (arg == "--vars")
+            config.variables = std::atoi(next().c_str());
+        else if (arg == "--sessions")
+            config.sessions = std::atoi(next().c_str());
+        else if (arg == "--exprs")
+            config.expressionsPerSession = std::atoi(next().c_str());
+        else if (arg == "--repeat")
+            config.repeat = std::atoi(next().c_str());
+        else if (arg == "--malformed")
+            malformedPercent = std::atoi(next().c_str());
+        else if (arg == "--seed")
+            config.seed = std::strtoull(next().c_str(), nullptr, 10);
+        else if (arg == "--min-time")
+            minSeconds = std::atof(next().c_str());
+        else if (arg == "--filter")
+            filter = next();
+        else if (arg == "--json")
+            jsonFile = next();
+        else if (arg == "--baseline")
+            baselineFile = next();
+        else
+        {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    Workload workload = generateWorkload(config);
+    const std::vector<std::string> &exprs = workload.expressions;
+    double exprBytes = 0;
+    for (const auto &e : exprs)
+        exprBytes += static_cast<double>(e.size());
+
+    std::vector<std::string_view> sessions = splitSessions(workload.text);
+
+    // Shared state for the evaluation stages: every expression parsed and
+    // compiled once, with all workload variables defined
+    SymbolTable symbols;
+    for (int v = 0; v < config.variables; v++)
+    {
+        symbols.set(variableName(v), 1.5 + v);
+    }
+
+    AstArena parsed;
+    std::vector<NodeIndex> roots;
+    std::vector<Program> programs;
+    for (const auto &e : exprs)
+    {
+        Lexer lex(e);
+        Parser parser(lex, parsed, symbols);
+        NodeIndex root = parser.parseExpression().value();
+        foldConstants(parsed, root);
+        roots.push_back(root);
+        programs.push_back(Compiler().compile(parsed, root));
+    }
+
+    // The same expressions hash-consed (--cse): repeated subexpressions
+    // become shared nodes computed once
+    AstArena sharedParsed;
+    std::vector<NodeIndex> sharedRoots;
+    std::vector<Program> sharedPrograms;
+    size_t temps = 0;
+    for (const auto &e : exprs)
+    {
+        Lexer lex(e);
+        Parser parser(lex, sharedParsed, symbols, true);
+        NodeIndex root = parser.parseExpression().value();
+        foldConstants(sharedParsed, root);
+        sharedRoots.push_back(root);
+        sharedPrograms.push_back(Compiler().compile(sharedParsed, root));
+        temps += sharedPrograms.back().temps;
+    }
+    std::fprintf(stderr, "nodes: %zu as trees, %zu hash-consed (%.1f%% fewer), %zu shared subexpressions\n",
+                 parsed.size(), sharedParsed.size(),
+                 parsed.size() ? 100.0 * (1.0 - static_cast<double>(sharedParsed.size()) / parsed.size()) : 0.0, temps);
+
+    std::vector<double> values;
+    {
+        Evaluator eval(symbols, parsed);
+        for (NodeIndex root : roots)
+        {
+            Expected<double> result = eval.evaluate(root);
+            values.push_back(result ? result.value() : 0);
+        }
+    }
+
+    std::vector<BenchResult> results;
+    auto run = [&](const std::string &name, bool bytes, auto pass)
+    {
+        if (!filter.empty() && name.find(filter) == std::string::npos)
+            return;
+        results.push_back(measure(name, bytes, pass));
+        const BenchResult &r = results.back();
+        std::fprintf(stderr, "%-16s %12.1f ns/op %14.1f %-6s %8.2f allocs/op\n",
+                     r.name.c_str(), r.nsPerOp, r.throughput, r.unit.c_str(), r.allocsPerOp);
+    };
+
+    run("splitSessions", true, [&]
+        {
+            SessionSplitter splitter(workload.text);
+            std::string_view s;
+            uint64_t n = 0;
+            while (splitter.next(s))
+                n++;
+            return Work{n, static_cast<double>(workload.text.size())}; });
+
+    run("lexer", true, [&]
+        {
+            uint64_t tokens = 0;
+            for (const auto &e : exprs)
+            {
+                Lexer lex(e);
+                while (lex.getNextToken().type != TokenType::EndOfFile)
+                    tokens++;
+            }
+            return Work{tokens, exprBytes}; });
+
+    run("parser", false, [&]
+        {
+            static AstArena arena;
+            SymbolTable table;
+            for (const auto &e : exprs)
+            {
+                arena.clear();
+                Lexer lex(e);
+                Parser parser(lex, arena, table);
+                parser.parseExpression();
+            }
+            return Work{exprs.size(), static_cast<double>(exprs.size())}; });
+
+    // Folding rewrites the tree, so it is timed together with parsing;
+    // the difference to "parser" is the cost of the pass
+    run("parser+fold", false, [&]
+        {
+            static AstArena arena;
+            SymbolTable table;
+            for (const auto &e : exprs)
+            {
+                arena.clear();
+                Lexer lex(e);
+                Parser parser(lex, arena, table);
+                Expected<NodeIndex> root = parser.parseExpression();
+                if (root)
+                    foldConstants(arena, root.value());
+            }
+            return Work{exprs.size(), static_cast<double>(exprs.size())}; });
+
+    run("parser+cse", false, [&]
+        {
+            static AstArena arena;
+            SymbolTable table;
+            for (const auto &e : exprs)
+            {
+                arena.clear();
+                Lexer lex(e);
+                Parser parser(lex, arena, table, true);
+                parser.parseExpression();
+            }
+            return Work{exprs.size(), static_cast<double>(exprs.size())}; });
+
+    run("evaluator", false, [&]
+        {
+            Evaluator eval(symbols, parsed);
+            double sink = 0;
+            for (NodeIndex root : roots)
+            {
+                Expected<double> result = eval.evaluate(root);
+                if (result)
+                    sink += result.value();
+            }
+            doNotOptimize(sink);
+            return Work{roots.size(), static_cast<double>(roots.size())}; });
+
+    run("evaluator+cse", false, [&]
+        {
+            Evaluator eval(symbols, sharedParsed);
+            double sink = 0;
+            for (NodeIndex root : sharedRoots)
+            {
+                Expected<double> result = eval.evaluate(root);
+                if (result)
+                    sink += result.value();
+            }
+            doNotOptimize(sink);
+            return Work{sharedRoots.size(), static_cast<double>(sharedRoots.size())}; });
+
+    // Parsing and tree evaluation of nesting far deeper than the workload's
+    // (parentheses and a right-associative ^ chain): time per level should
+    // not grow with the depth
+    const size_t deepLevels = 100000;
+    std::string deepParens = std::string(deepLevels, '(') + "x";
+    std::string deepPowers;
+    for (size_t i = 0; i < deepLevels; i++)
+    {
+        deepParens += "+1)";
+        deepPowers += "x^";
+    }
+    deepPowers += "1";
+    run("deep", false, [&]
+        {
+            static AstArena arena;
+            SymbolTable table;
+            table.set("x", 1);
+            double sink = 0;
+            for (const std::string *e : {&deepParens, &deepPowers})
+            {
+                arena.clear();
+                Lexer lex(*e);
+                Parser parser(lex, arena, table);
+                NodeIndex root = parser.parseExpression().value();
+                sink += Evaluator(table, arena).evaluate(root).value();
+            }
+            doNotOptimize(sink);
+            return Work{2 * deepLevels, 2.0 * deepLevels}; });
+
+    // One --cse line with many shared subtrees, "(x+k)*(x+k)" summed over
+    // k, through every pass that looks shared nodes up: time per shared
+    // subtree should not grow with their number
+    for (size_t count : {size_t(10000), size_t(40000)})
+    {
+        std::string wide;
+        for (size_t k = 0; k < count; k++)
+        {
+            std::string term = "(x+" + std::to_string(k) + ")";
+            wide += (k ? " + " : "") + term + "*" + term;
+        }
+        run("cse-wide/" + std::to_string(count / 1000) + "k", false, [&]
+            {
+                static AstArena arena;
+                SymbolTable table;
+                table.set("x", 1);
+                arena.clear();
+                Lexer lex(wide);
+                Parser parser(lex, arena, table, true);
+                NodeIndex root = parser.parseExpression().value();
+                Integer exact;
+                foldIntegers(arena, root, wide, exact);
+                foldConstants(arena, root);
+                double sink = Evaluator(table, arena).evaluate(root).value();
+                Program program = Compiler().compile(arena, root);
+                sink += VirtualMachine(table).run(program).value();
+                doNotOptimize(sink);
+                return Work{count, static_cast<double>(count)}; });
+    }
+
+    run("vm", false, [&]
+        {
+            VirtualMachine vm(symbols);
+            double sink = 0;
+            for (const Program &p : programs)
+            {
+                Expected<double> result = vm.run(p);
+                if (result)
+                    sink += result.value();
+            }
+            doNotOptimize(sink);
+            return Work{programs.size(), static_cast<double>(programs.size())}; });
+
+    run("vm+cse", false, [&]
+        {
+            VirtualMachine vm(symbols);
+            double sink = 0;
+            for (const Program &p : sharedPrograms)
+            {
+                Expected<double> result = vm.run(p);
+                if (result)
+                    sink += result.value();
+            }
+            doNotOptimize(sink);
+            return Work{sharedPrograms.size(), static_cast<double>(sharedPrograms.size())}; });
+
+    // Native code for the same programs, variables read from a slot array
+    // indexed by symbol id. Programs that load an undefined name (or that
+    // the JIT declines) stay on the interpreter.
+    std::vector<double> slots(config.variables);
+    for (int v = 0; v < config.variables; v++)
+    {
+        symbols.get(variableName(v), slots[v]);
+    }
+    std::vector<std::unique_ptr<JitProgram>> natives;
+    size_t nativeCount = 0;
+    for (const Program &p : programs)
+    {
+        bool defined = true;
+        for (const Instruction &ins : p.code)
+            defined = defined && (ins.op != OpCode::LoadVar || symbols.isSet(ins.operand));
+        natives.push_back(defined ? std::make_unique<JitProgram>(p) : nullptr);
+        nativeCount += defined && natives.back()->compiled();
+    }
+    std::fprintf(stderr, "jit: %zu of %zu programs compiled\n", nativeCount, programs.size());
+
+    // Repeated evaluation of a few hot programs, the case the JIT is for
+    const size_t hotCount = std::min<size_t>(16, programs.size());
+    run("vm-hot", false, [&]
+        {
+            VirtualMachine vm(symbols);
+            double sink = 0;
+            for (size_t r = 0; r < programs.size(); r++)
+            {
+                Expected<double> result = vm.run(programs[r % hotCount]);
+                if (result)
+                    sink += result.value();
+            }
+            doNotOptimize(sink);
+            return Work{programs.size(), static_cast<double>(programs.size())}; });
+
+    run("jit-hot", false, [&]
+        {
+            VirtualMachine vm(symbols);
+            double sink = 0;
+            for (size_t r = 0; r < programs.size(); r++)
+            {
+                size_t i = r % hotCount;
+                double value;
+                if (natives[i] && natives[i]->compiled() && natives[i]->run(slots.data(), value))
+                {
+                    sink += value;
+                    continue;
+                }
+                Expected<double> result = vm.run(programs[i]);
+                if (result)
+                    sink += result.value();
+            }
+            doNotOptimize(sink);
+            return Work{programs.size(), static_cast<double>(programs.size())}; });
+
+    // A formula fixed in the source, for every row of a table: compiled at
+    // run time for the VM, or unrolled at compile time by constexprCalc.h
+    const size_t formulaRows = 100000;
+    {
+        SymbolTable formulaSymbols;
+        SymbolId x = formulaSymbols.intern("x"), y = formulaSymbols.intern("y");
+        AstArena formulaNodes;
+        Lexer lex(FIXED_FORMULA());
+        Parser parser(lex, formulaNodes, formulaSymbols);
+        NodeIndex root = parser.parseExpression().value();
+        foldConstants(formulaNodes, root);
+        Program formula = Compiler().compile(formulaNodes, root);
+
+        run("formula/vm", false, [&]
+            {
+                VirtualMachine vm(formulaSymbols);
+                double sink = 0;
+                for (size_t r = 0; r < formulaRows; r++)
+                {
+                    formulaSymbols.set(x, static_cast<double>(r));
+                    formulaSymbols.set(y, 0.5 * static_cast<double>(r));
+                    Expected<double> result = vm.run(formula);
+                    if (result)
+                        sink += result.value();
+                }
+                doNotOptimize(sink);
+                return Work{formulaRows, static_cast<double>(formulaRows)}; });
+    }
+
+    // The same through libcalc's engine: compiled once, variables bound by id
+    for (bool jit : {false, true})
+    {
+        CompileOptions options;
+        options.jit = jit;
+        EvaluationContext context(CompiledExpression::compile(FIXED_FORMULA(), options).value());
+        run(jit ? "formula/engine+jit" : "formula/engine", false, [&]
+            {
+                double sink = 0;
+                for (size_t r = 0; r < formulaRows; r++)
+                {
+                    context.bind(0, static_cast<double>(r));
+                    context.bind(1, 0.5 * static_cast<double>(r));
+                    Expected<double> result = context.evaluate();
+                    if (result)
+                        sink += result.value();
+                }
+                doNotOptimize(sink);
+                return Work{formulaRows, static_cast<double>(formulaRows)}; });
+    }
+
+    run("formula/constexpr", false, [&]
+        {
+            using namespace constcalc::literals;
+            static constexpr auto formula = FIXED_FORMULA(_expr).with("x"_var, "y"_var);
+            double sink = 0;
+            for (size_t r = 0; r < formulaRows; r++)
+                sink += formula(static_cast<double>(r), 0.5 * static_cast<double>(r));
+            doNotOptimize(sink);
+            return Work{formulaRows, static_cast<double>(formulaRows)}; });
+
+    run("formatDouble", false, [&]
+        {
+            char buffer[FormatDoubleMax];
+            size_t total = 0;
+            for (double v : values)
+                total += formatDouble(v, buffer);
+            doNotOptimize(total);
+            return Work{values.size(), static_cast<double>(values.size())}; });
+
+    run("session", true, [&]
+        {
+            static OutputBuffer out;
+            int index = 1;
+            for (std::string_view s : sessions)
+            {
+                out.clear();
+                runSession(s, index++, out);
+            }
+            return Work{sessions.size(), static_cast<double>(workload.text.size())}; });
+
+    // Typed evaluation: integer-only lines in int64/__int128/BigInt
+    run("session+exact", true, [&]
+        {
+            static OutputBuffer out;
+            SessionOptions exact;
+            exact.exactIntegers = true;
+            int index = 1;
+            for (std::string_view s : sessions)
+            {
+                out.clear();
+                runSession(s, index++, out, exact);
+            }
+            return Work{sessions.size(), static_cast<double>(workload.text.size())}; });
+
+    // The same sessions with --malformed percent of the expression lines
+    // damaged: the cost of reporting errors
+    WorkloadConfig dirtyConfig = config;
+    dirtyConfig.malformed = malformedPercent;
+    Workload dirty = generateWorkload(dirtyConfig);
+    std::vector<std::string_view> dirtySessions = splitSessions(dirty.text);
+    run("session+malformed", true, [&]
+        {
+            static OutputBuffer out;
+            int index = 1;
+            for (std::string_view s : dirtySessions)
+            {
+                out.clear();
+                runSession(s, index++, out);
+            }
+            return Work{dirtySessions.size(), static_cast<double>(dirty.text.size())}; });
+
+    // Baseline for the stage above: the same work plus one exception per
+    // error line, as the parser, evaluator and VM used to throw. Unwinding
+    // is a single frame here, so this is a lower bound of the old cost.
+    run("session+malformed/throw", true, [&]
+        {
+            static OutputBuffer out;
+            int index = 1;
+            size_t caught = 0;
+            for (std::string_view s : dirtySessions)
+            {
+                out.clear();
+                runSession(s, index++, out);
+                std::string_view text = out.view();
+                for (size_t pos = text.find("Error: "); pos != std::string_view::npos; pos = text.find("Error: ", pos + 1))
+                {
+                    try
+                    {
+                        throwError(text.substr(pos + 7, text.find('\n', pos) - pos - 7));
+                    }
+                    catch (const std::runtime_error &)
+                    {
+                        caught++;
+                    }
+                }
+            }
+            doNotOptimize(caught);
+            return Work{dirtySessions.size(), static_cast<double>(dirty.text.size())}; });
+
+    // Each math tier over blocks of values, then its accuracy
+    std::vector<MathCase> cases = mathCases(config.seed);
+    double worst[math::AccuracyCount][5] = {};
+    double nsPerValue[math::AccuracyCount][5] = {};
+    for (int a = 0; a < math::AccuracyCount; a++)
+    {
+        const math::Kernels &kernels = math::kernels(static_cast<math::Accuracy>(a));
+        for (size_t f = 0; f < cases.size(); f++)
+        {
+            const MathCase &c = cases[f];
+            std::vector<double> out;
+            std::string name = std::string(c.name) + "/" + math::accuracyName(static_cast<math::Accuracy>(a));
+            size_t before = results.size();
+            run(name, false, [&]
+                {
+                    runMathKernel(kernels, c, out);
+                    return Work{c.x.size(), static_cast<double>(c.x.size())}; });
+            if (results.size() > before)
+                nsPerValue[a][f] = results.back().nsPerOp;
+
+            runMathKernel(kernels, c, out);
+            for (size_t i = 0; i < out.size(); i++)
+                worst[a][f] = std::max(worst[a][f], ulpError(out[i], c.exact[i]));
+        }
+    }
+    std::fprintf(stderr, "\n%-6s", "math");
+    for (int a = 0; a < math::AccuracyCount; a++)
+        std::fprintf(stderr, " %9s max ulp %6s", math::accuracyName(static_cast<math::Accuracy>(a)), "ns");
+    std::fprintf(stderr, "\n");
+    for (size_t f = 0; f < cases.size(); f++)
+    {
+        std::fprintf(stderr, "%-6s", cases[f].name);
+        for (int a = 0; a < math::AccuracyCount; a++)
+            std::fprintf(stderr, " %17.3f %6.2f", worst[a][f], nsPerValue[a][f]);
+        std::fprintf(stderr, "\n");
+    }
+    std::fprintf(stderr, "\n");
+
+    // The workload as a text file and precompiled with --compile: time to
+    // the first session's output (open, map, first session) and a whole run
+    const std::filesystem::path tempDir = std::filesystem::temp_directory_path();
+    const std::string textPath = (tempDir / "calc-bench.txt").string();
+    const std::string compiledPath = (tempDir / "calc-bench.calcb").string();
+    std::ofstream(textPath, std::ios::binary) << workload.text;
+    compileSessions(workload.text, compiledPath, true);
+
+    auto runText = [&](bool firstOnly)
+    {
+        static OutputBuffer out;
+        MappedFile file(textPath);
+        SessionSplitter splitter(file.view());
+        std::string_view s;
+        uint64_t count = 0;
+        while (splitter.next(s))
+        {
+            if (trim(s).empty())
+                continue;
+            out.clear();
+            runSession(s, static_cast<int>(++count), out);
+            if (firstOnly)
+                break;
+        }
+        return count;
+    };
+    auto runCompiled = [&](bool firstOnly)
+    {
+        static OutputBuffer out;
+        MappedFile file(compiledPath);
+        CompiledFile compiled(file.view());
+        size_t count = firstOnly ? 1 : compiled.sessionCount();
+        for (size_t i = 0; i < count; i++)
+        {
+            out.clear();
+            compiled.runSession(i, out);
+        }
+        return count;
+    };
+
+    run("text-first", false, [&]
+        {
+            runText(true);
+            return Work{1, 1}; });
+
+    run("calcb-first", false, [&]
+        {
+            runCompiled(true);
+            return Work{1, 1}; });
+
+    run("text-file", false, [&]
+        {
+            uint64_t count = runText(false);
+            return Work{1, static_cast<double>(count)}; });
+
+    run("calcb-file", false, [&]
+        {
+            uint64_t count = runCompiled(false);
+            return Work{1, static_cast<double>(count)}; });
+
+    std::filesystem::remove(textPath);
+    std::filesystem::remove(compiledPath);
+
+    // Same pass with --stats probes active; runs last since stats stay on
+    stats::enable();
+    run("session+stats", true, [&]
+        {
+            static OutputBuffer out;
+            int index = 1;
+            for (std::string_view s : sessions)
+            {
+                out.clear();
+                runSession(s, index++, out);
+            }
+            return Work{sessions.size(), static_cast<double>(workload.text.size())}; });
+
+    const BenchResult *plain = nullptr, *instrumented = nullptr;
+    for (const BenchResult &r : results)
+    {
+        if (r.name == "session")
+            plain = &r;
+        else if (r.name == "session+stats")
+            instrumented = &r;
+    }
+    if (plain && instrumented && plain->nsPerOp > 0)
+    {
+        std::fprintf(stderr, "stats overhead   %+11.1f%%\n", (instrumented->nsPerOp / plain->nsPerOp - 1) * 100);
+    }
+
+    if (!jsonFile.empty())
+    {
+        std::ofstream out(jsonFile);
+        writeJson(out, config, results);
+    }
+    else
+    {
+        writeJson(std::cout, config, results);
+    }
+
+    if (!baselineFile.empty())
+    {
+        std::vector<BenchResult> baseline = loadBaseline(baselineFile);
+        std::fprintf(stderr, "\n%-16s %12s %12s %9s\n", "vs baseline", "ns/op", "baseline", "change");
+        for (const BenchResult &r : results)
+        {
+            for (const BenchResult &b : baseline)
+            {
+                if (b.name != r.name || b.nsPerOp <= 0)
+                    continue;
+                std::fprintf(stderr, "%-16s %12.1f %12.1f %+8.1f%%\n", r.name.c_str(), r.nsPerOp, b.nsPerOp,
+                             (r.nsPerOp / b.nsPerOp - 1) * 100);
+            }
+        }
+    }
+    return 0;
+}
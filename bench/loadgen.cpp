@@ -0,0 +1,298 @@
+// Load generator for `calc --serve`.
+//
+//   bin/loadgen --socket PATH [--connections N] [--requests N]
+//               [--pipeline N] [--sessions-per-request N] [--input FILE]
+//               [--verify] [--depth N] [--mix DEC:HEX:BIN] [--vars N]
+//               [--seed N]
+//
+// Every connection keeps up to --pipeline requests in flight. Requests are
+// sessions of --input (or of a generated workload), grouped
+// --sessions-per-request at a time. Reports requests/s and latency
+// percentiles; --verify also compares every response with the output
+// computed locally.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "workload.h"
+#include "mappedFile.h"
+#include "outputBuffer.h"
+#include "session.h"
+#include "utils.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    std::string socketPath;
+    size_t connections = 4;
+    size_t requests = 20000; // in total
+    size_t pipeline = 8;
+    size_t sessionsPerRequest = 1;
+    bool verify = false;
+};
+
+struct ConnectionResult
+{
+    std::vector<double> latencies; // microseconds
+    size_t mismatches = 0;
+    bool failed = false;
+};
+
+static int connectTo(const std::string &path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0)
+        return fd;
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+// One connection: send 'count' requests starting at 'first' (round robin
+// over 'requests'), never more than 'pipeline' unanswered at once
+static void drive(const Options &options, const std::vector<std::string> &requests,
+                  const std::vector<std::string> &expected, size_t first, size_t count,
+                  ConnectionResult &result)
+{
+    int fd = connectTo(options.socketPath);
+    if (fd < 0)
+    {
+        result.failed = true;
+        return;
+    }
+
+    std::deque<std::pair<size_t, Clock::time_point>> inFlight;
+    std::string sending;
+    size_t sent = 0;
+    size_t received = 0;
+    std::string response;
+    char buffer[64 * 1024];
+
+    while (received < count)
+    {
+        while (sent < count && inFlight.size() < options.pipeline)
+        {
+            size_t index = (first + sent) % requests.size();
+            sending.append(requests[index]);
+            sending.push_back('\0');
+            inFlight.emplace_back(index, Clock::now());
+            sent++;
+        }
+
+        pollfd p = {fd, static_cast<short>(POLLIN | (sending.empty() ? 0 : POLLOUT)), 0};
+        if (poll(&p, 1, 10000) <= 0 || (p.revents & (POLLERR | POLLHUP) && !(p.revents & POLLIN)))
+        {
+            result.failed = true;
+            break;
+        }
+
+        if (p.revents & POLLOUT)
+        {
+            ssize_t n = send(fd, sending.data(), sending.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n > 0)
+                sending.erase(0, static_cast<size_t>(n));
+        }
+
+        if (p.revents & POLLIN)
+        {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n <= 0)
+            {
+                result.failed = true;
+                break;
+            }
+
+            size_t start = 0;
+            for (size_t i = 0; i < static_cast<size_t>(n); i++)
+            {
+                if (buffer[i] != '\0')
+                    continue;
+                response.append(buffer + start, i - start);
+                start = i + 1;
+
+                auto [index, sentAt] = inFlight.front();
+                inFlight.pop_front();
+                result.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sentAt).count());
+                if (options.verify && response != expected[index])
+                    result.mismatches++;
+                response.clear();
+                received++;
+            }
+            response.append(buffer + start, static_cast<size_t>(n) - start);
+        }
+    }
+    close(fd);
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    WorkloadConfig config;
+    std::string inputFile;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string
+        { return i + 1 < argc ? argv[++i] : ""; };
+
+        if (arg == "--socket")
+            options.socketPath = next();
+        else if (arg == "--connections")
+            options.connections = std::strtoul(next().c_str(), nullptr, 10);
+        else if (arg == "--requests")
+            options.requests = std::strtoul(next().c_str(), nullptr, 10);
+        else if (arg == "--pipeline")
+            options.pipeline = std::strtoul(next().c_str(), nullptr, 10);
+        else if (arg == "--sessions-per-request")
+            options.sessionsPerRequest = std::strtoul(next().c_str(), nullptr, 10);
+        else if (arg == "--input")
+            inputFile = next();
+        else if (arg == "--verify")
+            options.verify = true;
+        else if (arg == "--depth")
+            config.depth = std::atoi(next().c_str());
+        else if (arg == "--mix")
+            std::sscanf(next().c_str(), "%d:%d:%d", &config.decimalWeight, &config.hexWeight, &config.binaryWeight);
+        else if (arg == "--vars")
+            config.variables = std::atoi(next().c_str());
+        else if (arg == "--seed")
+            config.seed = std::strtoull(next().c_str(), nullptr, 10);
+        else
+        {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    if (options.socketPath.empty() || options.connections == 0 || options.pipeline == 0 ||
+        options.sessionsPerRequest == 0)
+    {
+        std::cerr << "Usage: loadgen --socket PATH [--connections N] [--requests N] [--pipeline N]\n"
+                  << "               [--sessions-per-request N] [--input FILE] [--verify]\n";
+        return 1;
+    }
+
+    // Request texts: groups of consecutive sessions
+    std::string text;
+    if (!inputFile.empty())
+    {
+        MappedFile file(inputFile);
+        if (!file.isOpen())
+        {
+            std::cerr << "Error: Could not read " << inputFile << "\n";
+            return 1;
+        }
+        text.assign(file.view());
+    }
+    else
+    {
+        text = generateWorkload(config).text;
+    }
+
+    std::vector<std::string> requests;
+    SessionSplitter splitter(text);
+    std::string_view session;
+    std::string request;
+    size_t grouped = 0;
+    while (splitter.next(session))
+    {
+        if (trim(session).empty())
+            continue;
+        request.append(session);
+        request.append("\n----------\n");
+        if (++grouped == options.sessionsPerRequest)
+        {
+            requests.push_back(std::move(request));
+            request.clear();
+            grouped = 0;
+        }
+    }
+    if (!request.empty())
+        requests.push_back(std::move(request));
+    if (requests.empty())
+    {
+        std::cerr << "Error: no sessions to send\n";
+        return 1;
+    }
+
+    std::vector<std::string> expected;
+    if (options.verify)
+    {
+        for (const std::string &r : requests)
+        {
+            OutputBuffer out;
+            SessionSplitter sessions(r);
+            int index = 1;
+            while (sessions.next(session))
+            {
+                if (!trim(session).empty())
+                    runSession(session, index++, out);
+            }
+            expected.emplace_back(out.view());
+        }
+    }
+
+    std::vector<ConnectionResult> results(options.connections);
+    std::vector<std::thread> threads;
+    size_t perConnection = options.requests / options.connections;
+    auto start = Clock::now();
+    for (size_t c = 0; c < options.connections; c++)
+    {
+        size_t count = perConnection + (c < options.requests % options.connections ? 1 : 0);
+        threads.emplace_back(drive, std::cref(options), std::cref(requests), std::cref(expected),
+                             c * perConnection, count, std::ref(results[c]));
+    }
+    for (std::thread &t : threads)
+        t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> latencies;
+    size_t mismatches = 0;
+    bool failed = false;
+    for (const ConnectionResult &r : results)
+    {
+        latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+        mismatches += r.mismatches;
+        failed = failed || r.failed;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::printf("requests     %zu in %.3f s over %zu connections (pipeline %zu)\n",
+                latencies.size(), seconds, options.connections, options.pipeline);
+    std::printf("throughput   %.0f requests/s\n", static_cast<double>(latencies.size()) / seconds);
+    std::printf("latency      p50 %.1f us  p99 %.1f us  max %.1f us\n",
+                percentile(latencies, 0.50), percentile(latencies, 0.99),
+                latencies.empty() ? 0.0 : latencies.back());
+    if (options.verify)
+        std::printf("verified     %zu mismatches\n", mismatches);
+    if (failed)
+        std::fprintf(stderr, "Error: a connection failed before all its responses arrived\n");
+    return failed || mismatches ? 1 : 0;
+}
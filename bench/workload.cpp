@@ -0,0 +1,161 @@
+#include "workload.h"
+
+#include <random>
+#include <vector>
+
+// Variable names are letters only, like the calculator's identifiers
+std::string variableName(int n)
+{
+    std::string s;
+    do
+    {
+        s.insert(s.begin(), static_cast<char>('a' + n % 26));
+        n /= 26;
+    } while (n > 0);
+    return "v" + s;
+}
+
+namespace
+{
+    class Generator
+    {
+    public:
+        explicit Generator(const WorkloadConfig &cfg)
+            : config(cfg), rng(cfg.seed) {}
+
+        std::string literal()
+        {
+            int total = config.decimalWeight + config.hexWeight + config.binaryWeight;
+            int pick = uniform(0, total - 1);
+            unsigned value = static_cast<unsigned>(uniform(0, 255));
+
+            if (pick < config.decimalWeight)
+            {
+                if (uniform(0, 3) == 0)
+                    return std::to_string(value) + "." + std::to_string(uniform(0, 99));
+                return std::to_string(value);
+            }
+            if (pick < config.decimalWeight + config.hexWeight)
+            {
+                static const char digits[] = "0123456789ABCDEF";
+                std::string s = "0x";
+                s += digits[value >> 4];
+                s += digits[value & 15];
+                return s;
+            }
+
+            std::string bits;
+            for (int b = 7; b >= 0; b--)
+                bits += ((value >> b) & 1) ? '1' : '0';
+            return uniform(0, 1) ? "0b" + bits : bits + "b";
+        }
+
+        int percent()
+        {
+            return uniform(0, 99);
+        }
+
+        std::string variable()
+        {
+            return variableName(uniform(0, config.variables - 1));
+        }
+
+        // A whole line; subexpressions may repeat earlier ones of the line
+        std::string line(int depth, bool withVariables)
+        {
+            seen.clear();
+            return expression(depth, withVariables);
+        }
+
+        // Damage a line the way dirty inputs are damaged; each kind ends in
+        // a different error
+        std::string malformed(const std::string &line)
+        {
+            switch (uniform(0, 5))
+            {
+            case 0:
+                return "(" + line;                  // Parser error: expected ')'
+            case 1:
+                return line + " +";                 // Null AST node
+            case 2:
+                return line + " * undefined";       // Undefined variable
+            case 3:
+                return line + " / (1 - 1)";         // Division by zero
+            case 4:
+                return "sin " + line;               // expected '(' after function name
+            default:
+                return line + " + 0xFFFFFFFFFFFFFFFFF"; // stoul
+            }
+        }
+
+    private:
+        const WorkloadConfig &config;
+        std::mt19937_64 rng;
+        std::vector<std::string> seen; // parenthesized subexpressions of the current line
+
+        int uniform(int lo, int hi)
+        {
+            return std::uniform_int_distribution<int>(lo, hi)(rng);
+        }
+
+        std::string expression(int depth, bool withVariables)
+        {
+            if (depth <= 0 || uniform(0, 4) == 0)
+            {
+                if (withVariables && config.variables > 0 && uniform(0, 2) == 0)
+                    return variable();
+                return literal();
+            }
+
+            if (config.repeat > 0 && !seen.empty() && uniform(0, 99) < config.repeat)
+                return seen[static_cast<size_t>(uniform(0, static_cast<int>(seen.size()) - 1))];
+
+            switch (uniform(0, 5))
+            {
+            case 0:
+            {
+                std::string e = "(" + expression(depth - 1, withVariables) + ")";
+                seen.push_back(e);
+                return e;
+            }
+            case 1:
+                return (uniform(0, 1) ? "sin(" : "cos(") + expression(depth - 1, withVariables) + ")";
+            default:
+            {
+                static const char *ops[] = {" + ", " - ", " * ", " / ", " ^ "};
+                // Keep powers small so values stay finite
+                int op = uniform(0, 4);
+                std::string right = (op == 4) ? std::to_string(uniform(0, 3)) : expression(depth - 1, withVariables);
+                return expression(depth - 1, withVariables) + ops[op] + right;
+            }
+            }
+        }
+    };
+}
+
+Workload generateWorkload(const WorkloadConfig &config)
+{
+    Generator gen(config);
+    Workload w;
+
+    for (int s = 0; s < config.sessions; s++)
+    {
+        w.text += "----\n";
+        for (int v = 0; v < config.variables; v++)
+        {
+            // Definitions only use literals, so every variable is defined
+            std::string rhs = gen.line(config.depth / 2, false);
+            w.text += variableName(v) + " = " + rhs + "\n";
+            w.expressions.push_back(rhs);
+        }
+        for (int e = 0; e < config.expressionsPerSession; e++)
+        {
+            std::string expr = gen.line(config.depth, true);
+            if (config.malformed > 0 && gen.percent() < config.malformed)
+                expr = gen.malformed(expr);
+            w.text += expr + "\n";
+            w.expressions.push_back(expr);
+        }
+    }
+    return w;
+}
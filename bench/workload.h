@@ -0,0 +1,35 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Shape of a synthetic calculator input
+struct WorkloadConfig
+{
+    int depth = 4;              // maximum expression nesting depth
+    int decimalWeight = 2;      // relative frequency of decimal literals
+    int hexWeight = 1;          // ... of hex literals (0x1F)
+    int binaryWeight = 1;       // ... of binary literals (0b101 / 101b)
+    int variables = 4;          // variables defined per session
+    int sessions = 2000;        // number of sessions
+    int expressionsPerSession = 3;
+    int repeat = 0;             // percent of subexpressions that repeat an earlier one of the same line
+    int malformed = 0;          // percent of expression lines made invalid (parse or evaluation error)
+    uint64_t seed = 42;
+};
+
+// Generated input: the full file text plus the individual pieces
+struct Workload
+{
+    std::string text;                     // "----" separated sessions
+    std::vector<std::string> expressions; // every right-hand side and expression line
+};
+
+Workload generateWorkload(const WorkloadConfig &config);
+
+// Name of the n-th generated variable: "va", "vb", ..., "vz", "vba", ...
+std::string variableName(int n);
+
+#endif // WORKLOAD_H
@@ -0,0 +1,55 @@
+#include "ast.h"
+
+NodeIndex AstArena::add(const ASTNode &node)
+{
+    nodes.push_back(node);
+    return static_cast<NodeIndex>(nodes.size() - 1);
+}
+
+NodeIndex AstArena::addNumber(double value, uint32_t offset)
+{
+    return add(ASTNode{NodeKind::Number, 0, FunctionId::Sin, false, false, ErrorCode::None, NullNode, NullNode, 0, 0, 0,
+                       offset, value});
+}
+
+// The error text is copied into the text pool
+NodeIndex AstArena::addInvalidNumber(std::string_view error, uint32_t offset)
+{
+    ASTNode node{NodeKind::Number, 0, FunctionId::Sin, true, false, ErrorCode::InvalidNumber, NullNode, NullNode, 0,
+                 static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(error.size()), offset, 0.0};
+    strings.append(error.data(), error.size());
+    return add(node);
+}
+
+// An operand the parser did not find: evaluating it fails, at the point in
+// evaluation order where the operand would have been used
+NodeIndex AstArena::addMissing(uint32_t offset)
+{
+    return add(ASTNode{NodeKind::Number, 0, FunctionId::Sin, true, false, ErrorCode::MissingOperand, NullNode, NullNode,
+                       0, 0, 0, offset, 0.0});
+}
+
+NodeIndex AstArena::addVariable(uint32_t symbol, uint32_t offset)
+{
+    return add(ASTNode{NodeKind::Variable, 0, FunctionId::Sin, false, false, ErrorCode::None, NullNode, NullNode, symbol,
+                       0, 0, offset, 0.0});
+}
+
+NodeIndex AstArena::addBinary(char op, NodeIndex left, NodeIndex right, uint32_t offset)
+{
+    return add(ASTNode{NodeKind::BinaryOp, op, FunctionId::Sin, false, false, ErrorCode::None, left, right, 0, 0, 0,
+                       offset, 0.0});
+}
+
+NodeIndex AstArena::addFunction(FunctionId func, NodeIndex argument, uint32_t offset)
+{
+    return add(ASTNode{NodeKind::Function, 0, func, false, false, ErrorCode::None, argument, NullNode, 0, 0, 0, offset,
+                       0.0});
+}
+
+void AstArena::clear()
+{
+    // Nodes are trivially destructible, so this is O(1)
+    nodes.clear();
+    strings.clear();
+}
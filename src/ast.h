@@ -0,0 +1,98 @@
+#ifndef AST_H
+#define AST_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "diagnostic.h"
+
+// Nodes are referenced by their position in the arena
+using NodeIndex = uint32_t;
+constexpr NodeIndex NullNode = UINT32_MAX; // no node
+
+enum class NodeKind : uint8_t
+{
+    Number,    // literal, or a literal that failed to convert
+    Variable,  // a, radius, pi
+    BinaryOp,  // + - * / ^
+    Function   // sin, cos
+};
+
+enum class FunctionId : uint8_t
+{
+    Sin,
+    Cos
+};
+
+// --------------------------------------
+// AST node: one flat record for every kind
+// --------------------------------------
+struct ASTNode
+{
+    NodeKind kind;
+    char op;          // BinaryOp: operator character
+    FunctionId func;  // Function: which function
+    bool invalid;     // Number: conversion failed, or no operand was found
+    bool shared;      // has more than one parent (hash-consed parse)
+    ErrorCode error;  // invalid Number: InvalidNumber or MissingOperand
+    NodeIndex left;   // BinaryOp left operand, Function argument
+    NodeIndex right;  // BinaryOp right operand
+    uint32_t symbol;  // Variable: interned name id in the session's SymbolTable
+    uint32_t textOffset; // Number: conversion error, in the arena's text pool
+    uint32_t textLength;
+    uint32_t offset;  // where the node's token starts in the parsed text: the
+                      // literal, name or operator (or what stood in place of
+                      // a missing operand); error columns come from here
+    double value;     // Number: value converted at parse time
+};
+
+// --------------------------------------
+// Bump arena holding every node of a session.
+// Nodes are appended in allocation order and never freed one by one;
+// clear() drops them all at once and keeps the memory for reuse.
+// --------------------------------------
+class AstArena
+{
+public:
+    NodeIndex addNumber(double value, uint32_t offset);
+    NodeIndex addInvalidNumber(std::string_view error, uint32_t offset);
+    NodeIndex addMissing(uint32_t offset);
+    NodeIndex addVariable(uint32_t symbol, uint32_t offset);
+    NodeIndex addBinary(char op, NodeIndex left, NodeIndex right, uint32_t offset);
+    NodeIndex addFunction(FunctionId func, NodeIndex argument, uint32_t offset);
+
+    // Drop the node added last (one without text), e.g. after finding an
+    // equal node to share instead
+    void removeLast() { nodes.pop_back(); }
+
+    const ASTNode &operator[](NodeIndex i) const { return nodes[i]; }
+    ASTNode &operator[](NodeIndex i) { return nodes[i]; }
+
+    // Conversion error of an invalid Number node
+    std::string_view text(const ASTNode &node) const
+    {
+        return std::string_view(strings.data() + node.textOffset, node.textLength);
+    }
+
+    // What evaluating an invalid Number node reports
+    Diagnostic error(const ASTNode &node) const
+    {
+        return Diagnostic{node.error, node.offset, text(node)};
+    }
+
+    size_t size() const { return nodes.size(); }
+
+    // Release every node in O(1)
+    void clear();
+
+private:
+    std::vector<ASTNode> nodes;
+    std::string strings;
+
+    NodeIndex add(const ASTNode &node);
+
+};
+
+#endif // AST_H
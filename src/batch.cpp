@@ -0,0 +1,512 @@
+#include "batch.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CALC_HAVE_AVX2_KERNELS 1
+#endif
+
+#include "lexer.h"
+#include "parser.h"
+#include "optimizer.h"
+#include "mappedFile.h"
+#include "utils.h"
+#include "outputBuffer.h"
+#include "mathKernels.h"
+
+// --------------------------------------
+// Block kernels: a[i] = a[i] op b[i] for one block of rows
+// --------------------------------------
+namespace
+{
+    struct Kernels
+    {
+        void (*add)(double *a, const double *b, size_t n);
+        void (*sub)(double *a, const double *b, size_t n);
+        void (*mul)(double *a, const double *b, size_t n);
+        void (*div)(double *a, const double *b, size_t n);
+        bool (*anyZero)(const double *b, size_t n);
+    };
+
+    void addScalar(double *a, const double *b, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            a[i] = a[i] + b[i];
+    }
+    void subScalar(double *a, const double *b, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            a[i] = a[i] - b[i];
+    }
+    void mulScalar(double *a, const double *b, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            a[i] = a[i] * b[i];
+    }
+    void divScalar(double *a, const double *b, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            a[i] = a[i] / b[i];
+    }
+    bool anyZeroScalar(const double *b, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            if (b[i] == 0)
+                return true;
+        return false;
+    }
+
+    const Kernels scalarKernels = {addScalar, subScalar, mulScalar, divScalar, anyZeroScalar};
+
+#ifdef CALC_HAVE_AVX2_KERNELS
+
+// Four rows per instruction, the tail of the block runs scalar
+#define CALC_AVX2_KERNEL(name, intrinsic, op)                                  \
+    __attribute__((target("avx2"))) void name(double *a, const double *b, size_t n) \
+    {                                                                          \
+        size_t i = 0;                                                          \
+        for (; i + 4 <= n; i += 4)                                             \
+            _mm256_storeu_pd(a + i, intrinsic(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i))); \
+        for (; i < n; i++)                                                     \
+            a[i] = a[i] op b[i];                                               \
+    }
+
+    CALC_AVX2_KERNEL(addAvx2, _mm256_add_pd, +)
+    CALC_AVX2_KERNEL(subAvx2, _mm256_sub_pd, -)
+    CALC_AVX2_KERNEL(mulAvx2, _mm256_mul_pd, *)
+    CALC_AVX2_KERNEL(divAvx2, _mm256_div_pd, /)
+
+#undef CALC_AVX2_KERNEL
+
+    __attribute__((target("avx2"))) bool anyZeroAvx2(const double *b, size_t n)
+    {
+        const __m256d zero = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            if (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(b + i), zero, _CMP_EQ_OQ)))
+                return true;
+        }
+        return anyZeroScalar(b + i, n - i);
+    }
+
+    const Kernels avx2Kernels = {addAvx2, subAvx2, mulAvx2, divAvx2, anyZeroAvx2};
+
+    const Kernels &kernels()
+    {
+        static const Kernels &chosen = __builtin_cpu_supports("avx2") ? avx2Kernels : scalarKernels;
+        return chosen;
+    }
+
+#else
+
+    const Kernels &kernels()
+    {
+        return scalarKernels;
+    }
+
+#endif
+
+    // Error codes: 0 = ok, 1 = division by zero, then one per Failure,
+    // then one per undefined variable (by symbol id)
+    const uint32_t DivisionByZero = 1;
+    const uint32_t FirstFailure = 2;
+}
+
+// --------------------------------------
+// Batch evaluator
+// --------------------------------------
+
+BatchEvaluator::BatchEvaluator(const Program &prog, SymbolTable &st, const ColumnSet &cols)
+    : program(prog), symbols(st), columns(cols)
+{
+    stack.resize(std::max<size_t>(program.maxStack, 1) * BlockSize);
+
+    for (size_t c = 0; c < columns.names.size(); c++)
+    {
+        SymbolId id = st.intern(columns.names[c]);
+        if (id >= columnOf.size())
+            columnOf.resize(id + 1, -1);
+        columnOf[id] = static_cast<int>(c);
+    }
+}
+
+uint32_t BatchEvaluator::undefinedCode(SymbolId id) const
+{
+    return FirstFailure + static_cast<uint32_t>(program.failures.size()) + id;
+}
+
+std::string BatchEvaluator::errorMessage(uint32_t code) const
+{
+    if (code == DivisionByZero)
+        return "Division by zero";
+    if (code - FirstFailure < program.failures.size())
+        return program.failures[code - FirstFailure].at(NoColumn).message();
+    return "Undefined variable: " + std::string(symbols.name(code - FirstFailure - static_cast<uint32_t>(program.failures.size())));
+}
+
+void BatchEvaluator::run(size_t first, size_t count, double *results, uint32_t *errors)
+{
+    const Kernels &k = kernels();
+    const math::Kernels &math = math::kernels();
+    double *top = stack.data(); // next free block
+    std::fill(errors, errors + count, 0u);
+
+    // Only the first error of a row is reported, like the scalar path
+    auto fail = [&](size_t row, uint32_t code)
+    {
+        if (errors[row] == 0)
+            errors[row] = code;
+    };
+
+    for (const Instruction &ins : program.code)
+    {
+        switch (ins.op)
+        {
+        case OpCode::PushConst:
+            std::fill(top, top + count, program.constants[ins.operand]);
+            top += BlockSize;
+            break;
+        case OpCode::LoadVar:
+        {
+            int c = ins.operand < columnOf.size() ? columnOf[ins.operand] : -1;
+            if (c < 0)
+            {
+                for (size_t i = 0; i < count; i++)
+                    fail(i, undefinedCode(ins.operand));
+            }
+            else
+            {
+                std::memcpy(top, columns.values[c].data() + first, count * sizeof(double));
+                const auto &valid = columns.valid[c];
+                if (!valid.empty())
+                {
+                    for (size_t i = 0; i < count; i++)
+                        if (!valid[first + i])
+                            fail(i, undefinedCode(ins.operand));
+                }
+            }
+            top += BlockSize;
+            break;
+        }
+        case OpCode::Add:
+            top -= BlockSize;
+            k.add(top - BlockSize, top, count);
+            break;
+        case OpCode::Sub:
+            top -= BlockSize;
+            k.sub(top - BlockSize, top, count);
+            break;
+        case OpCode::Mul:
+            top -= BlockSize;
+            k.mul(top - BlockSize, top, count);
+            break;
+        case OpCode::Div:
+            top -= BlockSize;
+            if (k.anyZero(top, count))
+            {
+                for (size_t i = 0; i < count; i++)
+                    if (top[i] == 0)
+                        fail(i, DivisionByZero);
+            }
+            k.div(top - BlockSize, top, count);
+            break;
+        case OpCode::Pow:
+            top -= BlockSize;
+            math.pow(top - BlockSize, top, count);
+            break;
+        case OpCode::Sin:
+            math.sin(top - BlockSize, count);
+            break;
+        case OpCode::Cos:
+            math.cos(top - BlockSize, count);
+            break;
+        case OpCode::Fail:
+            for (size_t i = 0; i < count; i++)
+                fail(i, FirstFailure + ins.operand);
+            top += BlockSize;
+            break;
+        case OpCode::StoreTemp: // not emitted: batch expressions are parsed without sharing
+        case OpCode::LoadTemp:
+            break;
+        }
+    }
+
+    std::memcpy(results, stack.data(), count * sizeof(double));
+}
+
+// --------------------------------------
+// Column loading
+// --------------------------------------
+
+// A cell is exactly one number literal, as the lexer reads it, with an
+// optional sign: "1e3" or "12abc" are invalid rather than read the way
+// strtod would
+static bool convertCell(std::string_view cell, double &value)
+{
+    cell = trim(cell);
+    bool negative = false;
+    if (!cell.empty() && (cell[0] == '-' || cell[0] == '+'))
+    {
+        negative = cell[0] == '-';
+        cell.remove_prefix(1);
+    }
+    if (cell.empty())
+        return false;
+
+    Lexer lex(cell);
+    Token token = lex.getNextToken();
+    if (token.type != TokenType::Number || token.offset != 0 || token.length != cell.size())
+        return false;
+
+    Expected<double> converted = convertNumber(cell);
+    if (!converted)
+        return false;
+    value = converted.value();
+    if (negative)
+        value = -value;
+    return true;
+}
+
+static bool loadBinaryColumns(std::string_view data, ColumnSet &columns, std::string &error)
+{
+    size_t pos = 8; // magic
+    auto read = [&](void *out, size_t n)
+    {
+        if (pos + n > data.size())
+            return false;
+        std::memcpy(out, data.data() + pos, n);
+        pos += n;
+        return true;
+    };
+
+    uint32_t columnCount;
+    uint64_t rowCount;
+    if (!read(&columnCount, sizeof(columnCount)) || !read(&rowCount, sizeof(rowCount)))
+    {
+        error = "truncated column file header";
+        return false;
+    }
+
+    for (uint32_t c = 0; c < columnCount; c++)
+    {
+        uint32_t length;
+        if (!read(&length, sizeof(length)) || pos + length > data.size())
+        {
+            error = "truncated column name";
+            return false;
+        }
+        columns.names.emplace_back(data.substr(pos, length));
+        pos += length;
+    }
+
+    if ((data.size() - pos) / sizeof(double) / std::max<uint32_t>(columnCount, 1) < rowCount)
+    {
+        error = "truncated column data";
+        return false;
+    }
+
+    columns.rows = static_cast<size_t>(rowCount);
+    for (uint32_t c = 0; c < columnCount; c++)
+    {
+        columns.values.emplace_back(columns.rows);
+        read(columns.values.back().data(), columns.rows * sizeof(double));
+        columns.valid.emplace_back();
+    }
+    return true;
+}
+
+static bool loadCsvColumns(std::string_view data, ColumnSet &columns, std::string &error)
+{
+    size_t pos = 0;
+    std::string_view line;
+    bool haveHeader = false;
+
+    while (nextLine(data, pos, line))
+    {
+        if (trim(line).empty())
+            continue;
+
+        size_t column = 0;
+        size_t start = 0;
+        while (true)
+        {
+            size_t comma = line.find(',', start);
+            std::string_view cell = line.substr(start, comma == std::string_view::npos ? std::string_view::npos : comma - start);
+
+            if (!haveHeader)
+            {
+                columns.names.emplace_back(trim(cell));
+                columns.values.emplace_back();
+                columns.valid.emplace_back();
+            }
+            else if (column < columns.names.size())
+            {
+                double value = 0;
+                bool ok = convertCell(cell, value);
+                auto &valid = columns.valid[column];
+                if (!ok && valid.empty())
+                {
+                    valid.assign(columns.rows, 1); // first bad cell in this column
+                    valid.push_back(0);
+                }
+                else if (!valid.empty())
+                    valid.push_back(ok ? 1 : 0);
+                columns.values[column].push_back(value);
+            }
+
+            column++;
+            if (comma == std::string_view::npos)
+                break;
+            start = comma + 1;
+        }
+
+        if (!haveHeader)
+        {
+            haveHeader = true;
+            continue;
+        }
+
+        // Short rows leave the remaining variables undefined
+        for (; column < columns.names.size(); column++)
+        {
+            auto &valid = columns.valid[column];
+            if (valid.empty())
+                valid.assign(columns.rows, 1);
+            valid.push_back(0);
+            columns.values[column].push_back(0);
+        }
+        columns.rows++;
+    }
+
+    if (!haveHeader)
+    {
+        error = "column file has no header row";
+        return false;
+    }
+    return true;
+}
+
+bool loadColumns(const std::string &filename, ColumnSet &columns, std::string &error)
+{
+    MappedFile file(filename);
+    if (!file.isOpen())
+    {
+        error = "Could not read file or file is empty.";
+        return false;
+    }
+
+    std::string_view data = file.view();
+    if (data.substr(0, 8) == "CALCCOL1")
+        return loadBinaryColumns(data, columns, error);
+    return loadCsvColumns(data, columns, error);
+}
+
+// --------------------------------------
+// calc --batch
+// --------------------------------------
+
+static bool endsWith(const std::string &s, const std::string &suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int runBatch(const std::string &expression, const std::string &columnFile,
+             const std::string &outputFile)
+{
+    ColumnSet columns;
+    std::string error;
+    if (!loadColumns(columnFile, columns, error))
+    {
+        std::cout << "Error: " << error << "\n";
+        return 1;
+    }
+
+    // Parse and compile once
+    SymbolTable symbols;
+    AstArena arena;
+    Program program;
+    std::string parseError;
+    Lexer lex(expression);
+    Parser parser(lex, arena, symbols);
+    Expected<NodeIndex> ast = parser.parseExpression();
+    if (ast)
+    {
+        foldConstants(arena, ast.value());
+        program = Compiler().compile(arena, ast.value());
+    }
+    else
+    {
+        parseError = "Error: " + ast.error().message();
+    }
+
+    bool binary = endsWith(outputFile, ".bin");
+    FILE *out = outputFile.empty() ? stdout : std::fopen(outputFile.c_str(), binary ? "wb" : "w");
+    if (!out)
+    {
+        std::cout << "Error: Could not open " << outputFile << "\n";
+        return 1;
+    }
+
+    {
+        OutputBuffer buffer(out);
+        if (binary)
+        {
+            uint32_t columnCount = 1, nameLength = 6;
+            uint64_t rowCount = columns.rows;
+            buffer.append(std::string_view("CALCCOL1", 8));
+            buffer.append(std::string_view(reinterpret_cast<const char *>(&columnCount), sizeof(columnCount)));
+            buffer.append(std::string_view(reinterpret_cast<const char *>(&rowCount), sizeof(rowCount)));
+            buffer.append(std::string_view(reinterpret_cast<const char *>(&nameLength), sizeof(nameLength)));
+            buffer.append("result");
+        }
+        else
+        {
+            buffer.append("result\n");
+        }
+
+        BatchEvaluator evaluator(program, symbols, columns);
+        double results[BatchEvaluator::BlockSize];
+        uint32_t errors[BatchEvaluator::BlockSize];
+
+        for (size_t first = 0; first < columns.rows; first += BatchEvaluator::BlockSize)
+        {
+            size_t count = std::min(BatchEvaluator::BlockSize, columns.rows - first);
+            if (parseError.empty())
+                evaluator.run(first, count, results, errors);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                if (binary)
+                {
+                    double value = (parseError.empty() && errors[i] == 0) ? results[i] : std::nan("");
+                    buffer.append(std::string_view(reinterpret_cast<const char *>(&value), sizeof(value)));
+                }
+                else if (!parseError.empty())
+                {
+                    buffer.append(parseError);
+                    buffer.append('\n');
+                }
+                else if (errors[i] != 0)
+                {
+                    buffer.append("Error: ");
+                    buffer.append(evaluator.errorMessage(errors[i]));
+                    buffer.append('\n');
+                }
+                else
+                {
+                    buffer.appendNumber(results[i]);
+                    buffer.append('\n');
+                }
+            }
+        }
+    }
+
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
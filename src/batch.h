@@ -0,0 +1,67 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "symbolTable.h"
+
+// --------------------------------------
+// Variable values for batch mode, one column per variable.
+// Loaded from a CSV file (header row of names, one row per binding) or
+// from a binary column file (see loadColumns).
+// --------------------------------------
+struct ColumnSet
+{
+    std::vector<std::string> names;
+    std::vector<std::vector<double>> values;
+    std::vector<std::vector<uint8_t>> valid; // per column; empty if every cell converted
+    size_t rows = 0;
+};
+
+// Binary column file layout (little endian):
+//   "CALCCOL1", uint32 columnCount, uint64 rowCount,
+//   columnCount x (uint32 nameLength, name bytes),
+//   columnCount x rowCount doubles, column after column.
+// Any other file is read as CSV. Returns false and sets 'error' on failure.
+bool loadColumns(const std::string &filename, ColumnSet &columns, std::string &error);
+
+// --------------------------------------
+// Runs one compiled Program over many rows at once.
+// Every instruction is applied to a whole block of rows before the next
+// one, using AVX2 when the CPU has it and plain loops otherwise. Each row
+// gets exactly the value (or error) the per-session path would give.
+// --------------------------------------
+class BatchEvaluator
+{
+public:
+    static constexpr size_t BlockSize = 256;
+
+    // Column names are interned into 'symbols' to match the program's slots
+    BatchEvaluator(const Program &program, SymbolTable &symbols, const ColumnSet &columns);
+
+    // Evaluate rows [first, first + count), count <= BlockSize.
+    // errors[i] is 0 for a good row, otherwise a code for errorMessage().
+    void run(size_t first, size_t count, double *results, uint32_t *errors);
+
+    std::string errorMessage(uint32_t code) const;
+
+private:
+    const Program &program;
+    const SymbolTable &symbols;
+    const ColumnSet &columns;
+    std::vector<int> columnOf; // symbol id -> column index, or -1
+    std::vector<double> stack; // maxStack blocks of BlockSize rows
+
+    uint32_t undefinedCode(SymbolId id) const;
+};
+
+// Entry point for `calc --batch`: evaluate 'expression' for every row of
+// 'columnFile' and write the results as a single column to 'outputFile'
+// (stdout if empty; binary column format if it ends in ".bin").
+int runBatch(const std::string &expression, const std::string &columnFile,
+             const std::string &outputFile);
+
+#endif // BATCH_H
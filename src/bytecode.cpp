@@ -0,0 +1,249 @@
+#include "bytecode.h"
+#include "mathKernels.h"
+#include "memoryTracker.h"
+#include "nodeSlots.h"
+#include "simpleStack.h"
+#include <cmath>
+
+// --------------------------------------
+// Compiler
+// --------------------------------------
+
+namespace
+{
+    // A node still to be compiled: first its operands are pushed
+    // (expanded = false), then its own instruction is emitted
+    struct Frame
+    {
+        NodeIndex index;
+        bool expanded;
+    };
+
+    // Reused by every compilation on this thread
+    thread_local SimpleStack<Frame> work;
+    thread_local NodeSlots temporaries; // temporary holding each shared node
+}
+
+Program Compiler::compile(const AstArena &arena, NodeIndex root)
+{
+    memtrack::Tag tag(memtrack::Compiler);
+    nodes = &arena;
+    program = Program();
+    depth = 0;
+    temporaries.reset(arena.size());
+    compileTree(root);
+    return std::move(program);
+}
+
+void Compiler::emit(OpCode op, uint32_t operand, int stackEffect, uint32_t column)
+{
+    program.code.push_back(Instruction{op, operand});
+    program.columns.push_back(column);
+    depth += stackEffect;
+    if (depth > program.maxStack)
+        program.maxStack = depth;
+}
+
+// Errors the tree walker would raise are deferred to run time, so they are
+// reported in the same order (e.g. an undefined variable on the left of a
+// missing operand still wins).
+void Compiler::emitFail(const Diagnostic &error, uint32_t column)
+{
+    program.failures.push_back(Failure{error.code, std::string(error.detail)});
+    emit(OpCode::Fail, static_cast<uint32_t>(program.failures.size() - 1), 1, column);
+}
+
+// Post-order walk on an explicit stack: operands first, then the operator
+void Compiler::compileTree(NodeIndex root)
+{
+    work.clear();
+    work.push(Frame{root, false});
+    while (!work.empty())
+    {
+        Frame frame = work.pop();
+        if (frame.expanded)
+        {
+            compileOperation(frame.index);
+            continue;
+        }
+        if (compileLeaf(frame.index))
+            continue;
+
+        const ASTNode &node = (*nodes)[frame.index];
+        work.push(Frame{frame.index, true});
+        if (node.kind == NodeKind::BinaryOp)
+            work.push(Frame{node.right, false});
+        work.push(Frame{node.left, false});
+    }
+}
+
+// Emit a node that needs no operands (or a shared node computed already);
+// false for an operation whose operands come first
+bool Compiler::compileLeaf(NodeIndex index)
+{
+    if (index == NullNode)
+    {
+        emitFail(Diagnostic{ErrorCode::MissingOperand, NoColumn, std::string_view()}, NoColumn);
+        return true;
+    }
+
+    const ASTNode &node = (*nodes)[index];
+    switch (node.kind)
+    {
+    case NodeKind::Number:
+        if (node.invalid)
+        {
+            emitFail(nodes->error(node), node.offset);
+            return true;
+        }
+        program.constants.push_back(node.value);
+        emit(OpCode::PushConst, static_cast<uint32_t>(program.constants.size() - 1), 1, node.offset);
+        return true;
+
+    case NodeKind::Variable:
+        emit(OpCode::LoadVar, node.symbol, 1, node.offset);
+        return true;
+
+    case NodeKind::BinaryOp:
+    case NodeKind::Function:
+        if (node.shared)
+        {
+            // Computed once, at its first use in evaluation order
+            uint32_t temp = temporaries.find(index);
+            if (temp != NoSlot)
+            {
+                emit(OpCode::LoadTemp, temp, 1, node.offset);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    emitFail(Diagnostic{ErrorCode::Other, NoColumn, "Unknown AST node type"}, node.offset);
+    return true;
+}
+
+// The operator of a node whose operands are on the stack
+void Compiler::compileOperation(NodeIndex index)
+{
+    const ASTNode &node = (*nodes)[index];
+    if (node.kind == NodeKind::BinaryOp)
+    {
+        switch (node.op)
+        {
+        case '+':
+            emit(OpCode::Add, 0, -1, node.offset);
+            break;
+        case '-':
+            emit(OpCode::Sub, 0, -1, node.offset);
+            break;
+        case '*':
+            emit(OpCode::Mul, 0, -1, node.offset);
+            break;
+        case '/':
+            emit(OpCode::Div, 0, -1, node.offset);
+            break;
+        case '^':
+            emit(OpCode::Pow, 0, -1, node.offset);
+            break;
+        default:
+            emitFail(Diagnostic{ErrorCode::Other, NoColumn, std::string("Unknown binary operator: ") + node.op},
+                     node.offset);
+            break;
+        }
+    }
+    else
+    {
+        emit(node.func == FunctionId::Sin ? OpCode::Sin : OpCode::Cos, 0, 0, node.offset);
+    }
+
+    if (node.shared)
+    {
+        uint32_t temp = static_cast<uint32_t>(program.temps++);
+        temporaries.set(index, temp);
+        emit(OpCode::StoreTemp, temp, 0, node.offset);
+    }
+}
+
+// --------------------------------------
+// Virtual machine
+// --------------------------------------
+
+VirtualMachine::VirtualMachine(SymbolTable &st)
+    : symbols(st) {}
+
+// Column of the instruction that failed
+static uint32_t columnOf(const uint32_t *columns, const Instruction *code, const Instruction *ins)
+{
+    return columns ? columns[ins - code] : NoColumn;
+}
+
+Expected<double> VirtualMachine::run(const Instruction *code, size_t size, const double *constants,
+                                     const Failure *failures, size_t maxStack, size_t temps,
+                                     const uint32_t *columns)
+{
+    memtrack::Tag tag(memtrack::Evaluator);
+    if (stack.size() < maxStack + temps)
+        stack.resize(maxStack + temps);
+
+    double *sp = stack.data(); // next free slot
+    double *temp = stack.data() + maxStack;
+
+    for (const Instruction *ins = code; ins != code + size; ins++)
+    {
+        switch (ins->op)
+        {
+        case OpCode::PushConst:
+            *sp++ = constants[ins->operand];
+            break;
+        case OpCode::LoadVar:
+            if (!symbols.get(ins->operand, *sp))
+            {
+                return Diagnostic{ErrorCode::UndefinedVariable, columnOf(columns, code, ins),
+                                  symbols.name(ins->operand)};
+            }
+            sp++;
+            break;
+        case OpCode::Add:
+            sp--;
+            sp[-1] = sp[-1] + sp[0];
+            break;
+        case OpCode::Sub:
+            sp--;
+            sp[-1] = sp[-1] - sp[0];
+            break;
+        case OpCode::Mul:
+            sp--;
+            sp[-1] = sp[-1] * sp[0];
+            break;
+        case OpCode::Div:
+            sp--;
+            if (sp[0] == 0)
+            {
+                return Diagnostic{ErrorCode::DivisionByZero, columnOf(columns, code, ins), std::string_view()};
+            }
+            sp[-1] = sp[-1] / sp[0];
+            break;
+        case OpCode::Pow:
+            sp--;
+            sp[-1] = math::pow(sp[-1], sp[0]);
+            break;
+        case OpCode::Sin:
+            sp[-1] = math::sin(sp[-1]);
+            break;
+        case OpCode::Cos:
+            sp[-1] = math::cos(sp[-1]);
+            break;
+        case OpCode::Fail:
+            return failures[ins->operand].at(columnOf(columns, code, ins));
+        case OpCode::StoreTemp:
+            temp[ins->operand] = sp[-1];
+            break;
+        case OpCode::LoadTemp:
+            *sp++ = temp[ins->operand];
+            break;
+        }
+    }
+
+    return sp[-1];
+}
@@ -0,0 +1,115 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "diagnostic.h"
+#include "symbolTable.h"
+
+// --------------------------------------
+// Instruction set (postfix, stack based)
+// --------------------------------------
+enum class OpCode : uint8_t
+{
+    PushConst, // push constants[operand]
+    LoadVar,   // push value of variable slot 'operand'
+    Add,       // a b -> a + b
+    Sub,       // a b -> a - b
+    Mul,       // a b -> a * b
+    Div,       // a b -> a / b (error if b == 0)
+    Pow,       // a b -> a ^ b
+    Sin,       // a -> sin(a)
+    Cos,       // a -> cos(a)
+    Fail,      // raise failures[operand]
+    StoreTemp, // a -> a, and keep a copy in temporary 'operand'
+    LoadTemp   // push temporary 'operand'
+};
+
+struct Instruction
+{
+    OpCode op;
+    uint32_t operand;
+};
+
+// Error raised by a Fail instruction, kept as the code and detail of its
+// Diagnostic so running it needs no message parsing
+struct Failure
+{
+    ErrorCode code;
+    std::string detail;
+
+    // Points into this Failure
+    Diagnostic at(uint32_t column) const { return Diagnostic{code, column, detail}; }
+};
+
+// --------------------------------------
+// Compiled expression: a flat instruction tape plus its pools
+// --------------------------------------
+struct Program
+{
+    std::vector<Instruction> code;
+    std::vector<double> constants;
+    std::vector<Failure> failures;
+    std::vector<uint32_t> columns; // text offset each instruction came from; empty if unknown
+    size_t maxStack = 0;
+    size_t temps = 0; // values of shared subexpressions (StoreTemp/LoadTemp)
+};
+
+// --------------------------------------
+// Lowers an AST into a Program
+// --------------------------------------
+class Compiler
+{
+public:
+    Program compile(const AstArena &arena, NodeIndex root);
+
+private:
+    const AstArena *nodes = nullptr;
+    Program program;
+    size_t depth = 0;
+
+    void emit(OpCode op, uint32_t operand, int stackEffect, uint32_t column);
+    void emitFail(const Diagnostic &error, uint32_t column);
+    void compileTree(NodeIndex root);
+    bool compileLeaf(NodeIndex index);
+    void compileOperation(NodeIndex index);
+};
+
+// --------------------------------------
+// Interpreter loop over a Program
+// --------------------------------------
+class VirtualMachine
+{
+public:
+    explicit VirtualMachine(SymbolTable &st);
+
+    // Run the program and return the value left on the stack.
+    // Errors are reported exactly like Evaluator does, as a Diagnostic.
+    Expected<double> run(const Program &program)
+    {
+        return run(program.code.data(), program.code.size(), program.constants.data(), program.failures.data(),
+                   program.maxStack, program.temps, program.columns.empty() ? nullptr : program.columns.data());
+    }
+
+    // Same for a program whose tape and pools live elsewhere (e.g. in a
+    // precompiled file). Without 'columns' errors have no column.
+    Expected<double> run(const Instruction *code, size_t size, const double *constants,
+                         const Failure *failures, size_t maxStack, size_t temps = 0,
+                         const uint32_t *columns = nullptr);
+
+    // Size the stack for 'program' now, so running it does not allocate
+    void reserve(const Program &program)
+    {
+        if (stack.size() < program.maxStack + program.temps)
+            stack.resize(program.maxStack + program.temps);
+    }
+
+private:
+    SymbolTable &symbols;
+    std::vector<double> stack;
+};
+
+#endif // BYTECODE_H
@@ -0,0 +1,332 @@
+#include "compiledFile.h"
+#include "session.h"
+#include "memoryTracker.h"
+#include "utils.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+static_assert(sizeof(Instruction) == 8 && offsetof(Instruction, operand) == 4,
+              "instructions are stored in the file as they are laid out in memory");
+
+// --------------------------------------
+// Writing
+// --------------------------------------
+
+namespace
+{
+    template <typename T>
+    void writeArray(std::ofstream &out, const std::vector<T> &items)
+    {
+        out.write(reinterpret_cast<const char *>(items.data()), static_cast<std::streamsize>(items.size() * sizeof(T)));
+    }
+}
+
+void compileSessions(std::string_view input, const std::string &outputFile, bool fold)
+{
+    SymbolTable symbols;
+    AstArena arena;
+
+    std::vector<calcb::SessionRecord> sessions;
+    std::vector<calcb::LineRecord> lines;
+    std::vector<double> constants;
+    std::vector<Instruction> code;
+    std::vector<Failure> failures;
+    std::unordered_map<std::string, uint32_t> failureIds; // by code and detail
+    std::string pool;
+
+    SessionSplitter splitter(input);
+    std::string_view session;
+    while (splitter.next(session))
+    {
+        if (trim(session).empty())
+            continue;
+
+        calcb::SessionRecord record{static_cast<uint32_t>(lines.size()), 0};
+        arena.clear();
+
+        size_t linePos = 0;
+        std::string_view line;
+        while (nextLine(session, linePos, line))
+        {
+            // Same line rules as runSession
+            std::string_view cleaned = trim(line);
+            if (cleaned == "" || cleaned == "\r" || cleaned == "\n")
+                continue;
+
+            calcb::LineRecord l{};
+            l.textOffset = pool.size();
+            l.textLength = static_cast<uint32_t>(cleaned.size());
+            pool.append(cleaned);
+
+            std::string_view expr = cleaned;
+            l.target = calcb::NoTarget;
+            size_t pos = cleaned.find('=');
+            if (pos != std::string_view::npos)
+            {
+                l.target = symbols.intern(trim(cleaned.substr(0, pos)));
+                expr = trim(cleaned.substr(pos + 1));
+            }
+
+            // Append the code with operands moved into the global pools
+            Program program = compileExpression(expr, arena, symbols, fold);
+            l.codeOffset = code.size();
+            l.codeLength = static_cast<uint32_t>(program.code.size());
+            l.maxStack = static_cast<uint32_t>(program.maxStack);
+            for (Instruction ins : program.code)
+            {
+                if (ins.op == OpCode::PushConst)
+                {
+                    constants.push_back(program.constants[ins.operand]);
+                    ins.operand = static_cast<uint32_t>(constants.size() - 1);
+                }
+                else if (ins.op == OpCode::Fail)
+                {
+                    const Failure &failure = program.failures[ins.operand];
+                    std::string key = static_cast<char>(failure.code) + failure.detail;
+                    auto found = failureIds.emplace(key, static_cast<uint32_t>(failures.size()));
+                    if (found.second)
+                        failures.push_back(failure);
+                    ins.operand = found.first->second;
+                }
+                code.push_back(ins);
+            }
+
+            lines.push_back(l);
+            record.lineCount++;
+        }
+        sessions.push_back(record);
+    }
+
+    // Names and error details go first in the text pool: they are all read when
+    // the file is opened, the echoed lines only as their sessions run
+    std::string strings;
+    auto addStrings = [&](size_t count, auto stringAt)
+    {
+        std::vector<calcb::StringRecord> records;
+        for (size_t i = 0; i < count; i++)
+        {
+            std::string_view s = stringAt(i);
+            records.push_back(calcb::StringRecord{strings.size(), s.size()});
+            strings.append(s);
+        }
+        return records;
+    };
+    std::vector<calcb::StringRecord> names = addStrings(symbols.size(), [&](size_t i)
+                                                        { return symbols.name(static_cast<SymbolId>(i)); });
+    std::vector<calcb::StringRecord> details = addStrings(failures.size(), [&](size_t i)
+                                                          { return std::string_view(failures[i].detail); });
+    std::vector<calcb::FailureRecord> errors;
+    for (size_t i = 0; i < failures.size(); i++)
+    {
+        errors.push_back(calcb::FailureRecord{details[i].offset, static_cast<uint32_t>(details[i].length),
+                                              static_cast<uint32_t>(failures[i].code)});
+    }
+    for (calcb::LineRecord &l : lines)
+    {
+        l.textOffset += strings.size();
+    }
+
+    calcb::FileHeader header{};
+    std::memcpy(header.magic, calcb::Magic, sizeof(header.magic));
+    header.version = calcb::Version;
+    header.sessionCount = static_cast<uint32_t>(sessions.size());
+    header.lineCount = static_cast<uint32_t>(lines.size());
+    header.symbolCount = static_cast<uint32_t>(names.size());
+    header.failureCount = static_cast<uint32_t>(errors.size());
+    header.constantCount = static_cast<uint32_t>(constants.size());
+    header.instructionCount = code.size();
+    header.textSize = strings.size() + pool.size();
+
+    std::ofstream out(outputFile, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeArray(out, sessions);
+    writeArray(out, lines);
+    writeArray(out, names);
+    writeArray(out, errors);
+    writeArray(out, constants);
+    writeArray(out, code);
+    out.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+    out.write(pool.data(), static_cast<std::streamsize>(pool.size()));
+    if (!out)
+        throw std::runtime_error("Could not write " + outputFile);
+}
+
+// --------------------------------------
+// Reading
+// --------------------------------------
+
+bool CompiledFile::isCompiled(std::string_view data)
+{
+    return data.size() >= sizeof(calcb::Magic) && std::memcmp(data.data(), calcb::Magic, sizeof(calcb::Magic)) == 0;
+}
+
+CompiledFile::CompiledFile(std::string_view data)
+    : vm(symbols)
+{
+    if (data.size() < sizeof(calcb::FileHeader) || !isCompiled(data))
+        throw std::runtime_error("not a precompiled session file");
+
+    header = reinterpret_cast<const calcb::FileHeader *>(data.data());
+    if (header->version != calcb::Version)
+    {
+        throw std::runtime_error("precompiled file version " + std::to_string(header->version) +
+                                 " is not supported (expected " + std::to_string(calcb::Version) +
+                                 "), compile it again");
+    }
+
+    // Section offsets; each size is checked against what is left so that
+    // nothing below can overflow
+    size_t pos = sizeof(calcb::FileHeader);
+    auto section = [&](uint64_t count, size_t itemSize)
+    {
+        if (count > (data.size() - pos) / itemSize)
+            throw std::runtime_error("precompiled file is truncated");
+        const char *start = data.data() + pos;
+        pos += static_cast<size_t>(count) * itemSize;
+        return start;
+    };
+    sessions = reinterpret_cast<const calcb::SessionRecord *>(section(header->sessionCount, sizeof(calcb::SessionRecord)));
+    lines = reinterpret_cast<const calcb::LineRecord *>(section(header->lineCount, sizeof(calcb::LineRecord)));
+    auto names = reinterpret_cast<const calcb::StringRecord *>(section(header->symbolCount, sizeof(calcb::StringRecord)));
+    auto errors = reinterpret_cast<const calcb::FailureRecord *>(section(header->failureCount, sizeof(calcb::FailureRecord)));
+    constants = reinterpret_cast<const double *>(section(header->constantCount, sizeof(double)));
+    code = reinterpret_cast<const Instruction *>(section(header->instructionCount, sizeof(Instruction)));
+    text = section(header->textSize, 1);
+
+    loadStrings(names, errors);
+}
+
+namespace
+{
+    [[noreturn]] void damaged()
+    {
+        throw std::runtime_error("precompiled file is damaged");
+    }
+}
+
+void CompiledFile::loadStrings(const calcb::StringRecord *names, const calcb::FailureRecord *errors)
+{
+    // Names are interned in file order so that ids match the operands
+    for (uint32_t i = 0; i < header->symbolCount; i++)
+    {
+        if (!inText(names[i].offset, names[i].length) ||
+            symbols.intern(std::string_view(text + names[i].offset, names[i].length)) != i)
+            damaged();
+    }
+    for (uint32_t i = 0; i < header->failureCount; i++)
+    {
+        if (!inText(errors[i].offset, errors[i].length) || errors[i].code == static_cast<uint32_t>(ErrorCode::None) ||
+            errors[i].code > static_cast<uint32_t>(ErrorCode::Other))
+            damaged();
+        failures.push_back(Failure{static_cast<ErrorCode>(errors[i].code),
+                                   std::string(text + errors[i].offset, errors[i].length)});
+    }
+}
+
+// Every operand in range and the stack never under- or overflows
+void CompiledFile::checkLine(const calcb::LineRecord &l) const
+{
+    if (!inText(l.textOffset, l.textLength) ||
+        (l.target != calcb::NoTarget && l.target >= header->symbolCount) ||
+        l.codeOffset > header->instructionCount || l.codeLength > header->instructionCount - l.codeOffset ||
+        l.maxStack > l.codeLength)
+        damaged();
+
+    size_t depth = 0;
+    for (const Instruction *ins = code + l.codeOffset; ins != code + l.codeOffset + l.codeLength; ins++)
+    {
+        size_t pops = 0;
+        uint32_t limit = 0;
+        switch (ins->op)
+        {
+        case OpCode::PushConst:
+            limit = header->constantCount;
+            break;
+        case OpCode::LoadVar:
+            limit = header->symbolCount;
+            break;
+        case OpCode::Fail:
+            limit = header->failureCount;
+            break;
+        case OpCode::Add:
+        case OpCode::Sub:
+        case OpCode::Mul:
+        case OpCode::Div:
+        case OpCode::Pow:
+            pops = 2;
+            break;
+        case OpCode::Sin:
+        case OpCode::Cos:
+            pops = 1;
+            break;
+        default:
+            damaged();
+        }
+        if ((pops == 0 && ins->operand >= limit) || depth < pops)
+            damaged();
+        depth = depth - pops + 1;
+        if (depth > l.maxStack)
+            damaged();
+    }
+    if (depth == 0)
+        damaged();
+}
+
+void CompiledFile::runSession(size_t index, OutputBuffer &out)
+{
+    memtrack::SessionScope scope(static_cast<int>(index) + 1);
+    // Records are checked as they are used, so the first answer does not
+    // wait for the whole file to be scanned
+    const calcb::SessionRecord &session = sessions[index];
+    if (session.firstLine > header->lineCount || session.lineCount > header->lineCount - session.firstLine)
+        damaged();
+    const calcb::LineRecord *first = lines + session.firstLine;
+    const calcb::LineRecord *last = first + session.lineCount;
+    for (const calcb::LineRecord *l = first; l != last; l++)
+        checkLine(*l);
+    symbols.reset();
+
+    out.append("Session ");
+    out.appendInt(static_cast<long long>(index) + 1);
+    out.append(":\n\n");
+    for (const calcb::LineRecord *l = first; l != last; l++)
+    {
+        out.append(std::string_view(text + l->textOffset, l->textLength));
+        out.append('\n');
+    }
+    out.append('\n');
+
+    bool answered = false;
+    for (const calcb::LineRecord *l = first; l != last; l++)
+    {
+        Expected<double> result = vm.run(code + l->codeOffset, l->codeLength, constants, failures.data(), l->maxStack);
+        if (!result)
+        {
+            out.append("Error: ");
+            result.error().appendMessage(out);
+            out.append('\n');
+        }
+        else if (l->target != calcb::NoTarget)
+        {
+            symbols.set(l->target, result.value());
+            continue;
+        }
+        else
+        {
+            out.append("Answer: ");
+            out.appendNumber(result.value());
+            out.append('\n');
+        }
+        answered = true;
+    }
+    if (!answered)
+        out.append("Answer: (no expression)\n");
+
+    static const std::string separator(50, '-');
+    out.append(separator);
+    out.append("\n\n");
+}
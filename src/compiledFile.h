@@ -0,0 +1,125 @@
+#ifndef COMPILED_FILE_H
+#define COMPILED_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bytecode.h"
+#include "outputBuffer.h"
+#include "symbolTable.h"
+
+// --------------------------------------
+// Precompiled session file (`calc --compile in.txt -o in.calcb`).
+//
+// Layout (little endian, every section 8-byte aligned):
+//   FileHeader
+//   sessionCount x SessionRecord   lines of each non-empty session
+//   lineCount    x LineRecord      echoed text, target and code of a line
+//   symbolCount  x StringRecord    interned names, id = index
+//   failureCount x FailureRecord   errors raised by Fail
+//   constantCount doubles          literal pool shared by all lines
+//   instructionCount x Instruction code of every line, back to back
+//   textSize bytes                 echoed lines, names and error details
+//
+// Operands are global: LoadVar indexes the symbol table, PushConst the
+// constant pool and Fail the failure table. Lines that do not parse are
+// stored as a single Fail with the parser's error.
+// --------------------------------------
+namespace calcb
+{
+    constexpr char Magic[8] = {'C', 'A', 'L', 'C', 'B', 'I', 'N', '\0'};
+    constexpr uint32_t Version = 2; // 2: failures carry their ErrorCode
+    constexpr uint32_t NoTarget = UINT32_MAX;
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t sessionCount;
+        uint32_t lineCount;
+        uint32_t symbolCount;
+        uint32_t failureCount;
+        uint32_t constantCount;
+        uint64_t instructionCount;
+        uint64_t textSize;
+    };
+
+    struct SessionRecord
+    {
+        uint32_t firstLine;
+        uint32_t lineCount;
+    };
+
+    struct LineRecord
+    {
+        uint64_t textOffset;
+        uint32_t textLength;
+        uint32_t target; // symbol assigned by "name = expr", or NoTarget
+        uint64_t codeOffset;
+        uint32_t codeLength;
+        uint32_t maxStack;
+    };
+
+    struct StringRecord
+    {
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    struct FailureRecord
+    {
+        uint64_t offset; // detail in the text pool
+        uint32_t length;
+        uint32_t code; // ErrorCode
+    };
+}
+
+// Compile every session of 'text' and write the result to 'outputFile'.
+// Throws std::runtime_error if the file cannot be written.
+void compileSessions(std::string_view text, const std::string &outputFile, bool foldConstants);
+
+// --------------------------------------
+// A precompiled file, evaluated straight from its (mapped) bytes: no
+// lexing or parsing, only the interpreter runs.
+// --------------------------------------
+class CompiledFile
+{
+public:
+    // True if 'data' starts like a precompiled file (of any version)
+    static bool isCompiled(std::string_view data);
+
+    // Reads the header, names and failures. Throws std::runtime_error for
+    // an unsupported version or a damaged file.
+    explicit CompiledFile(std::string_view data);
+
+    size_t sessionCount() const { return header->sessionCount; }
+
+    // Append the same block runSession() would produce for session 'index'
+    // (0-based) of the original text. The session's records are checked
+    // against the file bounds first; throws std::runtime_error if damaged.
+    void runSession(size_t index, OutputBuffer &out);
+
+private:
+    const calcb::FileHeader *header = nullptr;
+    const calcb::SessionRecord *sessions = nullptr;
+    const calcb::LineRecord *lines = nullptr;
+    const double *constants = nullptr;
+    const Instruction *code = nullptr;
+    const char *text = nullptr;
+
+    SymbolTable symbols;
+    std::vector<Failure> failures;
+    VirtualMachine vm;
+
+    bool inText(uint64_t offset, uint64_t length) const
+    {
+        return offset <= header->textSize && length <= header->textSize - offset;
+    }
+
+    void loadStrings(const calcb::StringRecord *names, const calcb::FailureRecord *errors);
+    void checkLine(const calcb::LineRecord &l) const;
+};
+
+#endif // COMPILED_FILE_H
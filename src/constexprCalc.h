@@ -0,0 +1,742 @@
+#ifndef CONSTEXPR_CALC_H
+#define CONSTEXPR_CALC_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+// --------------------------------------
+// Header-only lexer, parser and evaluator for expressions fixed in the
+// source, usable in constexpr context:
+//
+//   using namespace constcalc::literals;
+//   constexpr double mask = "0x1F + 0b101 * 3"_calc;      // 46, at compile time
+//
+//   constexpr auto area = "w * h / 2"_expr.with("w"_var, "h"_var);
+//   double a = area(3.0, 4.0);                            // 6, inlined code
+//
+// Numbers are read as Lexer::numberToken and convertNumber read them
+// (decimal, 0x hex, 0b or b-suffixed binary, same ranges and rounding) and
+// operators bind as in Parser: + - below * / below right-associative ^.
+// Unlike a session line, the text must be one whole expression.
+//
+// An error (anything the calculator would print as "Error: ...", or text
+// after the expression) is a compile error when the expression is
+// evaluated at compile time, with the calculator's message in the notes,
+// and a std::domain_error at run time. sin, cos and powers other than
+// exact integer ones have no compile-time value (libm is not constexpr):
+// they are accepted in functions of variables, which call libm at run time
+// as the calculator's default --math tier does.
+// --------------------------------------
+namespace constcalc
+{
+    namespace detail
+    {
+        constexpr double fail(const char *message)
+        {
+            return message ? throw std::domain_error(message) : 0.0;
+        }
+
+        constexpr bool constantEvaluated()
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            return __builtin_is_constant_evaluated();
+#else
+            return false;
+#endif
+        }
+
+        // --------------------------------------
+        // Lexer (the rules of Lexer::getNextToken)
+        // --------------------------------------
+        enum class TokenType : uint8_t
+        {
+            Number,
+            Identifier,
+            Function,
+            Operator,
+            LParen,
+            RParen,
+            End,
+            Other // "=", unknown characters
+        };
+
+        struct Token
+        {
+            TokenType type;
+            size_t offset;
+            size_t length;
+        };
+
+        constexpr bool isSpace(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+        }
+        constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+        constexpr bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+        constexpr bool isHexDigit(char c) { return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); }
+
+        // End of the number starting at 'pos' (decimal, 0x hex, 0b binary,
+        // binary ending in b)
+        constexpr size_t numberEnd(std::string_view text, size_t pos)
+        {
+            if (text[pos] == '0' && pos + 1 < text.size() && (text[pos + 1] == 'x' || text[pos + 1] == 'X'))
+            {
+                pos += 2;
+                while (pos < text.size() && isHexDigit(text[pos]))
+                    pos++;
+                return pos;
+            }
+            if (text[pos] == '0' && pos + 1 < text.size() && (text[pos + 1] == 'b' || text[pos + 1] == 'B'))
+            {
+                pos += 2;
+                while (pos < text.size() && (text[pos] == '0' || text[pos] == '1'))
+                    pos++;
+                return pos;
+            }
+            while (pos < text.size() && isDigit(text[pos]))
+                pos++;
+            if (pos < text.size() && text[pos] == '.')
+            {
+                pos++;
+                while (pos < text.size() && isDigit(text[pos]))
+                    pos++;
+                return pos;
+            }
+            if (pos < text.size() && (text[pos] == 'b' || text[pos] == 'B'))
+                pos++;
+            return pos;
+        }
+
+        constexpr Token nextToken(std::string_view text, size_t &pos)
+        {
+            while (pos < text.size() && isSpace(text[pos]))
+                pos++;
+            size_t start = pos;
+            if (pos == text.size())
+                return Token{TokenType::End, start, 0};
+
+            char c = text[pos];
+            TokenType type = TokenType::Other;
+            if (c == '(')
+                type = TokenType::LParen;
+            else if (c == ')')
+                type = TokenType::RParen;
+            else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '^')
+                type = TokenType::Operator;
+
+            if (isDigit(c))
+            {
+                pos = numberEnd(text, pos);
+                type = TokenType::Number;
+            }
+            else if (isAlpha(c))
+            {
+                while (pos < text.size() && isAlpha(text[pos]))
+                    pos++;
+                std::string_view name = text.substr(start, pos - start);
+                type = name == "sin" || name == "cos" ? TokenType::Function : TokenType::Identifier;
+            }
+            else
+            {
+                pos++;
+            }
+            return Token{type, start, pos - start};
+        }
+
+        // --------------------------------------
+        // Number conversion (the results of convertNumber)
+        // --------------------------------------
+
+        // Any decimal digit weighted by 2, wrapping like an int
+        constexpr double binaryValue(std::string_view digits)
+        {
+            unsigned int value = 0;
+            for (char c : digits)
+                value = value * 2 + static_cast<unsigned int>(c - '0');
+            return static_cast<double>(static_cast<int>(value));
+        }
+
+        // Same range as std::stoul
+        constexpr double hexValue(std::string_view digits)
+        {
+            unsigned long value = 0;
+            for (char c : digits)
+            {
+                unsigned long digit = isDigit(c) ? c - '0' : (c | 0x20) - 'a' + 10;
+                if (value > (~0UL - digit) / 16)
+                    return fail("stoul");
+                value = value * 16 + digit;
+            }
+            return static_cast<double>(value);
+        }
+
+        // Longest decimal literal converted exactly
+        constexpr size_t MaxDecimalLength = 400;
+
+        // Unsigned integer wide enough for the digits of such a literal
+        // scaled by a power of two (about 2 * 3.33 bits per digit, plus 56)
+        struct Wide
+        {
+            static constexpr int Limbs = static_cast<int>(MaxDecimalLength * 7 + 64) / 32 + 1;
+            uint32_t limb[Limbs] = {};
+            int used = 0;
+
+            constexpr void mulAdd(uint32_t factor, uint32_t add)
+            {
+                uint64_t carry = add;
+                for (int i = 0; i < used; i++)
+                {
+                    carry += static_cast<uint64_t>(limb[i]) * factor;
+                    limb[i] = static_cast<uint32_t>(carry);
+                    carry >>= 32;
+                }
+                if (carry != 0)
+                    limb[used++] = static_cast<uint32_t>(carry);
+            }
+
+            constexpr void shiftLeft(int bits)
+            {
+                int words = bits / 32, rest = bits % 32;
+                if (used == 0)
+                    return;
+                int top = used + words + 1;
+                for (int i = top - 1; i >= 0; i--)
+                {
+                    uint64_t high = i - words < used && i - words >= 0 ? limb[i - words] : 0;
+                    uint64_t low = rest != 0 && i - words - 1 >= 0 && i - words - 1 < used ? limb[i - words - 1] : 0;
+                    limb[i] = static_cast<uint32_t>(high << rest | low >> (32 - rest));
+                }
+                used = top;
+                trim();
+            }
+
+            constexpr void trim()
+            {
+                while (used > 0 && limb[used - 1] == 0)
+                    used--;
+            }
+
+            constexpr int bits() const
+            {
+                if (used == 0)
+                    return 0;
+                int n = (used - 1) * 32;
+                for (uint32_t top = limb[used - 1]; top != 0; top >>= 1)
+                    n++;
+                return n;
+            }
+
+            constexpr bool lessThan(const Wide &other) const
+            {
+                if (used != other.used)
+                    return used < other.used;
+                for (int i = used - 1; i >= 0; i--)
+                {
+                    if (limb[i] != other.limb[i])
+                        return limb[i] < other.limb[i];
+                }
+                return false;
+            }
+
+            // *this >= other
+            constexpr void subtract(const Wide &other)
+            {
+                int64_t borrow = 0;
+                for (int i = 0; i < used; i++)
+                {
+                    int64_t d = static_cast<int64_t>(limb[i]) - (i < other.used ? other.limb[i] : 0) - borrow;
+                    borrow = d < 0;
+                    limb[i] = static_cast<uint32_t>(d + (borrow << 32));
+                }
+                trim();
+            }
+        };
+
+        constexpr int bitCount(uint64_t x)
+        {
+            int n = 0;
+            for (; x != 0; x >>= 1)
+                n++;
+            return n;
+        }
+
+        // x * 2^exponent, exact for a normal result
+        constexpr double scaled(double x, int exponent)
+        {
+            for (; exponent > 0; exponent--)
+                x *= 2;
+            for (; exponent < 0; exponent++)
+                x /= 2;
+            return x;
+        }
+
+        // digits[.digits], rounded to nearest even as strtod does; "stod"
+        // where std::stod reports ERANGE (a result that overflows or is
+        // subnormal after rounding)
+        constexpr double decimalValue(std::string_view text)
+        {
+            if (text.size() > MaxDecimalLength)
+                return fail("decimal literal too long to convert at compile time");
+
+            // text = m / 10^k
+            Wide m, d;
+            d.limb[0] = 1;
+            d.used = 1;
+            bool fraction = false;
+            for (char c : text)
+            {
+                if (c == '.')
+                {
+                    fraction = true;
+                    continue;
+                }
+                if (!isDigit(c))
+                    break;
+                m.mulAdd(10, static_cast<uint32_t>(c - '0'));
+                if (fraction)
+                    d.mulAdd(10, 0);
+            }
+            if (m.used == 0)
+                return 0;
+
+            // q = floor(m * 2^s / 10^k), 55 or 56 bits
+            int s = 55 - (m.bits() - d.bits());
+            if (s > 0)
+                m.shiftLeft(s);
+            else
+                d.shiftLeft(-s);
+            uint64_t q = 0;
+            for (int i = 56; i >= 0; i--)
+            {
+                Wide step = d;
+                step.shiftLeft(i);
+                if (!m.lessThan(step))
+                {
+                    m.subtract(step);
+                    q |= uint64_t(1) << i;
+                }
+            }
+            bool sticky = m.used != 0;
+
+            // Keep 53 bits, fewer below the normal range
+            int exponent = bitCount(q) - 1 - s;
+            if (exponent < -1023)
+                return fail("stod");
+            int drop = bitCount(q) - 53 + (exponent < -1022 ? -1022 - exponent : 0);
+            uint64_t dropped = q & ((uint64_t(1) << drop) - 1), half = uint64_t(1) << (drop - 1);
+            q >>= drop;
+            if (dropped > half || (dropped == half && (sticky || (q & 1))))
+                q++;
+
+            int scale = drop - s;
+            exponent = bitCount(q) - 1 + scale;
+            if (exponent < -1022 || exponent > 1023)
+                return fail("stod");
+            return scaled(static_cast<double>(q), scale);
+        }
+
+        constexpr double numberValue(std::string_view raw)
+        {
+            if (raw.size() > 2 && raw[0] == '0' && (raw[1] == 'x' || raw[1] == 'X'))
+                return hexValue(raw.substr(2));
+            if (raw.size() > 2 && raw[0] == '0' && (raw[1] == 'b' || raw[1] == 'B'))
+                return binaryValue(raw.substr(2));
+            if (raw.size() > 1 && (raw.back() == 'b' || raw.back() == 'B'))
+                return binaryValue(raw.substr(0, raw.size() - 1));
+            return decimalValue(raw);
+        }
+
+        // --------------------------------------
+        // Operations (the calculator's default tier)
+        // --------------------------------------
+
+        // power() of integer.h: integral a ^ b is multiplied out while exact.
+        // Other powers only at run time, except the ones pow defines as 1.
+        constexpr double power(double base, double exponent)
+        {
+            if (exponent >= 0 && exponent <= 64 && base != 0 && base >= -(1LL << 53) && base <= (1LL << 53))
+            {
+                long long e = static_cast<long long>(exponent);
+                long long b = static_cast<long long>(base);
+                if (static_cast<double>(e) == exponent && static_cast<double>(b) == base)
+                {
+                    const long long limit = 1LL << 53;
+                    long long result = 1;
+                    bool exact = true;
+                    while (exact)
+                    {
+                        // |x * y| <= limit, without overflowing
+                        if (e & 1)
+                        {
+                            long long r = result < 0 ? -result : result, f = b < 0 ? -b : b;
+                            exact = r == 0 || f <= limit / r;
+                            result *= exact ? b : 1;
+                        }
+                        e >>= 1;
+                        if (e == 0)
+                            break;
+                        long long f = b < 0 ? -b : b;
+                        exact = exact && f <= limit / f;
+                        b *= exact ? b : 1;
+                    }
+                    if (exact)
+                        return static_cast<double>(result);
+                }
+            }
+            if (!constantEvaluated())
+                return std::pow(base, exponent);
+            if (exponent == 0 || base == 1)
+                return 1;
+            return fail("only exact integer powers have a compile-time value");
+        }
+
+        constexpr double function(char name, double x)
+        {
+            if (constantEvaluated())
+                return fail("sin and cos have no compile-time value");
+            return name == 's' ? std::sin(x) : std::cos(x);
+        }
+
+        constexpr double binary(char op, double left, double right)
+        {
+            switch (op)
+            {
+            case '+':
+                return left + right;
+            case '-':
+                return left - right;
+            case '*':
+                return left * right;
+            case '/':
+                return right == 0 ? fail("Division by zero") : left / right;
+            default:
+                return power(left, right);
+            }
+        }
+
+        // --------------------------------------
+        // Parser (the operator precedence of Parser, on fixed arrays)
+        // --------------------------------------
+        enum class NodeKind : uint8_t
+        {
+            Number,
+            Variable,
+            BinaryOp,
+            Function
+        };
+
+        // Children are added before their parent, so a tree evaluates
+        // front to back and its root is the last node
+        struct Node
+        {
+            NodeKind kind = NodeKind::Number;
+            char op = 0; // BinaryOp: + - * / ^, Function: 's' or 'c'
+            size_t left = 0;
+            size_t right = 0;
+            size_t slot = 0; // Variable: position in the variable list
+            double value = 0;
+        };
+
+        template <size_t Capacity>
+        struct Tree
+        {
+            std::array<Node, Capacity> nodes{};
+            size_t count = 0;
+
+            constexpr size_t root() const { return count - 1; }
+        };
+
+        constexpr int PowerLevel = 3;
+
+        constexpr int precedence(std::string_view text, const Token &t)
+        {
+            if (t.type != TokenType::Operator)
+                return 0;
+            char c = text[t.offset];
+            return c == '+' || c == '-' ? 1 : c == '^' ? PowerLevel : 2;
+        }
+
+        // 'Capacity' bounds the tokens of the text, and so the nodes, the
+        // operands and the pending operators and groups
+        template <size_t Capacity, size_t Names>
+        class Parser
+        {
+        public:
+            constexpr Parser(std::string_view text, const std::array<std::string_view, Names> &names)
+                : text(text), names(names) {}
+
+            constexpr Tree<Capacity> parse()
+            {
+                advance();
+                for (;;)
+                {
+                    // Operand: any number of '(' and 'sin(' in front of a primary
+                    while (openGroup())
+                    {
+                    }
+                    operands[operandCount++] = parsePrimary();
+
+                    // Operator, or the end of the innermost group
+                    for (;;)
+                    {
+                        int level = precedence(text, token);
+                        if (level != 0)
+                        {
+                            reduce(level);
+                            pending[pendingCount++] = Pending{text[token.offset], level, false};
+                            advance();
+                            break;
+                        }
+
+                        reduce(0);
+                        if (pendingCount == 0)
+                        {
+                            if (token.type != TokenType::End)
+                                fail("unexpected text after the expression");
+                            return tree;
+                        }
+                        closeGroup(pending[--pendingCount]);
+                    }
+                }
+            }
+
+        private:
+            // An operator waiting for its right operand (level 1 to 3), or
+            // an open "(" / function call (level 0)
+            struct Pending
+            {
+                char op = 0;
+                int level = 0;
+                bool call = false;
+            };
+
+            std::string_view text;
+            const std::array<std::string_view, Names> &names;
+            size_t pos = 0;
+            Token token{};
+            Tree<Capacity> tree{};
+            std::array<size_t, Capacity> operands{};
+            size_t operandCount = 0;
+            std::array<Pending, Capacity> pending{};
+            size_t pendingCount = 0;
+
+            constexpr void advance() { token = nextToken(text, pos); }
+
+            constexpr size_t add(const Node &node)
+            {
+                tree.nodes[tree.count] = node;
+                return tree.count++;
+            }
+
+            constexpr bool openGroup()
+            {
+                if (token.type == TokenType::Function)
+                {
+                    char name = text[token.offset];
+                    advance();
+                    if (token.type != TokenType::LParen)
+                        fail("Parser error: expected '(' after function name");
+                    advance();
+                    pending[pendingCount++] = Pending{name, 0, true};
+                    return true;
+                }
+                if (token.type == TokenType::LParen)
+                {
+                    advance();
+                    pending[pendingCount++] = Pending{0, 0, false};
+                    return true;
+                }
+                return false;
+            }
+
+            constexpr void closeGroup(const Pending &group)
+            {
+                if (token.type != TokenType::RParen)
+                    fail(group.call ? "Parser error: expected ')' after function argument" : "Parser error: expected ')'");
+                advance();
+                if (group.call)
+                {
+                    size_t &top = operands[operandCount - 1];
+                    top = add(Node{NodeKind::Function, group.op, top, 0, 0, 0});
+                }
+            }
+
+            constexpr void reduce(int level)
+            {
+                while (pendingCount > 0 && pending[pendingCount - 1].level != 0 &&
+                       (pending[pendingCount - 1].level > level ||
+                        (pending[pendingCount - 1].level == level && level != PowerLevel)))
+                {
+                    Pending op = pending[--pendingCount];
+                    size_t right = operands[--operandCount];
+                    size_t &left = operands[operandCount - 1];
+                    left = add(Node{NodeKind::BinaryOp, op.op, left, right, 0, 0});
+                }
+            }
+
+            constexpr size_t parsePrimary()
+            {
+                std::string_view lexeme = text.substr(token.offset, token.length);
+                if (token.type == TokenType::Number)
+                {
+                    advance();
+                    return add(Node{NodeKind::Number, 0, 0, 0, 0, numberValue(lexeme)});
+                }
+                if (token.type == TokenType::Identifier)
+                {
+                    advance();
+                    for (size_t slot = 0; slot < Names; slot++)
+                    {
+                        if (names[slot] == lexeme)
+                            return add(Node{NodeKind::Variable, 0, 0, 0, slot, 0});
+                    }
+                    fail("Undefined variable");
+                }
+                fail("Null AST node");
+                return 0;
+            }
+        };
+
+        template <size_t Capacity, size_t Names = 0>
+        constexpr Tree<Capacity> parse(std::string_view text, const std::array<std::string_view, Names> &names = {})
+        {
+            return Parser<Capacity, Names>(text, names).parse();
+        }
+
+        // A tree without variables, front to back
+        template <size_t Capacity>
+        constexpr double evaluate(const Tree<Capacity> &tree)
+        {
+            std::array<double, Capacity> values{};
+            for (size_t i = 0; i < tree.count; i++)
+            {
+                const Node &n = tree.nodes[i];
+                switch (n.kind)
+                {
+                case NodeKind::Number:
+                    values[i] = n.value;
+                    break;
+                case NodeKind::Function:
+                    values[i] = function(n.op, values[n.left]);
+                    break;
+                default:
+                    values[i] = binary(n.op, values[n.left], values[n.right]);
+                    break;
+                }
+            }
+            return values[tree.root()];
+        }
+
+        // Expression text as a type
+        template <char... Cs>
+        struct Text
+        {
+            static constexpr char chars[sizeof...(Cs) + 1] = {Cs..., '\0'};
+            static constexpr std::string_view view{chars, sizeof...(Cs)};
+        };
+    }
+
+    // Value of an expression without variables; a constant when used as
+    // one (portable to compilers without the literal operators below)
+    template <size_t N>
+    constexpr double evaluate(const char (&text)[N])
+    {
+        return detail::evaluate(detail::parse<N>(std::string_view(text, N - 1)));
+    }
+
+    // --------------------------------------
+    // A function of the variables Names... (_var literals), in that
+    // order: each variable is resolved to its argument at compile time and
+    // the tree is unrolled into straight-line code.
+    // --------------------------------------
+    template <typename Expression, typename... Names>
+    class Function
+    {
+    public:
+        template <typename... Values>
+        constexpr double operator()(Values... values) const
+        {
+            static_assert(sizeof...(Values) == sizeof...(Names), "one value per variable");
+            const std::array<double, sizeof...(Names)> slots{static_cast<double>(values)...};
+            return node<tree.root()>(slots);
+        }
+
+    private:
+        static constexpr std::array<std::string_view, sizeof...(Names)> names{Names::view...};
+        static constexpr auto tree = detail::parse<Expression::view.size() + 1>(Expression::view, names);
+
+        // Template depth grows with nesting, so this is for formulas, not
+        // machine-generated expressions
+        template <size_t Index>
+        static constexpr double node(const std::array<double, sizeof...(Names)> &slots)
+        {
+            constexpr detail::Node n = tree.nodes[Index];
+            if constexpr (n.kind == detail::NodeKind::Number)
+                return n.value;
+            else if constexpr (n.kind == detail::NodeKind::Variable)
+                return slots[n.slot];
+            else if constexpr (n.kind == detail::NodeKind::Function)
+                return detail::function(n.op, node<n.left>(slots));
+            else
+            {
+                // Left operand first, as the calculator evaluates
+                double left = node<n.left>(slots);
+                double right = node<n.right>(slots);
+                return detail::binary(n.op, left, right);
+            }
+        }
+    };
+
+    template <typename Text>
+    struct Expression
+    {
+        template <typename... Names>
+        constexpr Function<Text, Names...> with(Names...) const
+        {
+            return {};
+        }
+    };
+
+    // String literal operator templates are a GNU extension (GCC, Clang):
+    // they give each literal its own type, which is what lets _calc force
+    // evaluation at compile time
+    namespace literals
+    {
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wgnu-string-literal-operator-template"
+#endif
+        template <typename Char, Char... Cs>
+        constexpr double operator""_calc()
+        {
+            static_assert(std::is_same<Char, char>::value, "narrow string literals only");
+            using Text = detail::Text<Cs...>;
+            constexpr double value = detail::evaluate(detail::parse<sizeof...(Cs) + 1>(Text::view));
+            return value;
+        }
+
+        template <typename Char, Char... Cs>
+        constexpr Expression<detail::Text<Cs...>> operator""_expr()
+        {
+            static_assert(std::is_same<Char, char>::value, "narrow string literals only");
+            return {};
+        }
+
+        template <typename Char, Char... Cs>
+        constexpr detail::Text<Cs...> operator""_var()
+        {
+            static_assert(std::is_same<Char, char>::value, "narrow string literals only");
+            return {};
+        }
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+    }
+}
+
+#endif // CONSTEXPR_CALC_H
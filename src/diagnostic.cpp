@@ -0,0 +1,21 @@
+#include "diagnostic.h"
+
+namespace
+{
+    // Fixed messages, by code; the others are carried in 'detail'
+    const std::string_view messages[] = {
+        "",
+        "Parser error: expected ')'",
+        "Parser error: expected '(' after function name",
+        "Parser error: expected ')' after function argument",
+        "Null AST node",
+        "",
+        "Undefined variable: ",
+        "Division by zero",
+        ""};
+}
+
+std::string_view Diagnostic::prefix() const
+{
+    return messages[static_cast<int>(code)];
+}
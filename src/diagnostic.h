@@ -0,0 +1,88 @@
+#ifndef DIAGNOSTIC_H
+#define DIAGNOSTIC_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// --------------------------------------
+// Errors of lexing, parsing and evaluating one expression, returned as
+// values: a malformed line costs a branch, not an exception unwind.
+// --------------------------------------
+enum class ErrorCode : uint8_t
+{
+    None,
+    ExpectedParen,         // "(" without ")"
+    ExpectedCallParen,     // function name not followed by "("
+    ExpectedArgumentParen, // function argument without ")"
+    MissingOperand,        // no number, variable or "(" where one must be
+    InvalidNumber,         // literal out of range or malformed
+    UndefinedVariable,
+    DivisionByZero,
+    Other
+};
+
+constexpr uint32_t NoColumn = UINT32_MAX;
+
+struct Diagnostic
+{
+    ErrorCode code = ErrorCode::None;
+    uint32_t column = NoColumn; // offset in the expression text, if known
+    // Variable name (UndefinedVariable), conversion error (InvalidNumber) or
+    // whole message (Other). Points into the symbol table, arena or program
+    // that reported it: print it before reusing those.
+    std::string_view detail;
+
+    // The text the calculator prints after "Error: ", in two pieces so it
+    // can be appended without building a string
+    std::string_view prefix() const;
+
+    template <typename Out>
+    void appendMessage(Out &out) const
+    {
+        out.append(prefix());
+        out.append(detail);
+    }
+
+    std::string message() const
+    {
+        std::string text;
+        appendMessage(text);
+        return text;
+    }
+
+    // Parser errors, undefined variables, division by zero or anything
+    // else, as counted by --stats. A missing operand or a bad literal is
+    // malformed input too, whatever its message says.
+    bool parserError() const
+    {
+        return code == ErrorCode::ExpectedParen || code == ErrorCode::ExpectedCallParen ||
+               code == ErrorCode::ExpectedArgumentParen || code == ErrorCode::MissingOperand ||
+               code == ErrorCode::InvalidNumber;
+    }
+};
+
+// --------------------------------------
+// A value or the Diagnostic explaining why there is none
+// --------------------------------------
+template <typename T>
+class Expected
+{
+public:
+    Expected(T value) : result(std::move(value)) {}
+    Expected(const Diagnostic &error) : failure(error) {}
+
+    bool ok() const { return failure.code == ErrorCode::None; }
+    explicit operator bool() const { return ok(); }
+
+    const T &value() const { return result; }
+    T &value() { return result; }
+    const Diagnostic &error() const { return failure; }
+
+private:
+    T result{};
+    Diagnostic failure;
+};
+
+#endif // DIAGNOSTIC_H
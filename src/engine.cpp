@@ -0,0 +1,98 @@
+#include "engine.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parser.h"
+
+// The detail of a compile error outlives the program it came from
+static Diagnostic stableDiagnostic(Diagnostic error)
+{
+    if (error.code == ErrorCode::InvalidNumber)
+        error.detail = error.detail == "stoul" ? "stoul" : "stod";
+    else if (error.code != ErrorCode::UndefinedVariable)
+        error.detail = error.code == ErrorCode::Other ? "invalid expression" : std::string_view();
+    return error;
+}
+
+Expected<std::shared_ptr<const CompiledExpression>> CompiledExpression::compile(std::string_view text,
+                                                                                const CompileOptions &options)
+{
+    SymbolTable symbols;
+    AstArena arena;
+    Lexer lex(text);
+    Parser parser(lex, arena, symbols);
+    Expected<NodeIndex> root = parser.parseExpression();
+    if (!root)
+        return stableDiagnostic(root.error());
+
+    // A session ignores what follows the expression; here it is an error
+    const Token &rest = parser.stopToken();
+    if (rest.type != TokenType::EndOfFile)
+        return Diagnostic{ErrorCode::Other, rest.offset, "unexpected text after the expression"};
+
+    if (options.fold)
+        foldConstants(arena, root.value());
+
+    auto expression = std::make_shared<CompiledExpression>();
+    expression->code = Compiler().compile(arena, root.value());
+
+    // Errors every evaluation would report are reported now
+    const Program &code = expression->code;
+    for (size_t i = 0; i < code.code.size(); i++)
+    {
+        if (code.code[i].op == OpCode::Fail)
+            return stableDiagnostic(code.failures[code.code[i].operand].at(code.columns[i]));
+    }
+
+    // The parser interned the names in order of appearance, so symbol ids
+    // are already VariableIds
+    for (SymbolId id = 0; id < symbols.size(); id++)
+        expression->names.emplace_back(symbols.name(id));
+
+    if (options.jit && JitProgram::supported())
+    {
+        auto native = std::make_unique<JitProgram>(code);
+        if (native->compiled())
+            expression->jitted = std::move(native);
+    }
+    return std::shared_ptr<const CompiledExpression>(std::move(expression));
+}
+
+VariableId CompiledExpression::variable(std::string_view name) const
+{
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (names[i] == name)
+            return static_cast<VariableId>(i);
+    }
+    return NoVariable;
+}
+
+EvaluationContext::EvaluationContext(std::shared_ptr<const CompiledExpression> expression)
+    : compiled(std::move(expression)), vm(symbols), slots(compiled->variableCount()), unbound(slots.size())
+{
+    // Size the symbol table and the VM stack now, not on first use
+    for (VariableId id = 0; id < slots.size(); id++)
+    {
+        symbols.intern(compiled->variableName(id));
+        symbols.set(id, 0);
+    }
+    symbols.reset();
+    vm.reserve(compiled->program());
+}
+
+void EvaluationContext::clear()
+{
+    symbols.reset();
+    unbound = slots.size();
+}
+
+// Native code when there is some and every variable is bound; the
+// interpreter otherwise, and for the exact error if native code fails
+Expected<double> EvaluationContext::evaluate()
+{
+    const JitProgram *native = compiled->native();
+    double value;
+    if (native && unbound == 0 && native->run(slots.data(), value))
+        return value;
+    return vm.run(compiled->program());
+}
@@ -0,0 +1,111 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bytecode.h"
+#include "diagnostic.h"
+#include "jit.h"
+#include "symbolTable.h"
+
+// --------------------------------------
+// Embedding API of libcalc: compile an expression once, evaluate it many
+// times. libcalc.h is the same engine behind a C ABI.
+//
+//   auto compiled = CompiledExpression::compile("x * x + y");
+//   EvaluationContext context(compiled.value());     // one per thread
+//   VariableId x = compiled.value()->variable("x");
+//   context.bind(x, 3);
+//   Expected<double> result = context.evaluate();
+// --------------------------------------
+
+// Dense id of a variable of one compiled expression (0 .. count - 1, in
+// order of first appearance in the text)
+using VariableId = uint32_t;
+constexpr VariableId NoVariable = UINT32_MAX;
+
+struct CompileOptions
+{
+    bool fold = true; // constant folding, as without --no-fold
+    bool jit = false; // native code when the platform supports it (--jit)
+};
+
+// --------------------------------------
+// An expression compiled to bytecode (and native code with 'jit'). It is
+// never modified after compile(), so one instance can be evaluated by any
+// number of threads at once, each with its own EvaluationContext.
+// --------------------------------------
+class CompiledExpression
+{
+public:
+    // The expression, or the error that makes every evaluation fail: a
+    // parser error, a missing operand or a literal out of range, at its
+    // column in 'text'
+    static Expected<std::shared_ptr<const CompiledExpression>> compile(std::string_view text,
+                                                                       const CompileOptions &options = {});
+
+    size_t variableCount() const { return names.size(); }
+    std::string_view variableName(VariableId id) const { return names[id]; }
+
+    // Id of the variable called 'name', NoVariable if the expression does
+    // not use it
+    VariableId variable(std::string_view name) const;
+
+    const Program &program() const { return code; }
+
+    // Native code, or nullptr
+    const JitProgram *native() const { return jitted.get(); }
+
+private:
+    Program code; // LoadVar operands are VariableIds
+    std::vector<std::string> names;
+    std::unique_ptr<JitProgram> jitted;
+};
+
+// --------------------------------------
+// Variable values and evaluation scratch for one CompiledExpression, used
+// by one thread at a time. Everything is sized when the context is made,
+// so bind() and evaluate() do not allocate.
+// --------------------------------------
+class EvaluationContext
+{
+public:
+    explicit EvaluationContext(std::shared_ptr<const CompiledExpression> expression);
+
+    // The VM refers to 'symbols'
+    EvaluationContext(const EvaluationContext &) = delete;
+    EvaluationContext &operator=(const EvaluationContext &) = delete;
+
+    // Set a variable by id; false if the expression has no such variable
+    bool bind(VariableId id, double value)
+    {
+        if (id >= slots.size())
+            return false;
+        unbound -= !symbols.isSet(id);
+        symbols.set(id, value);
+        slots[id] = value;
+        return true;
+    }
+
+    // Forget every bound value
+    void clear();
+
+    // The value, or the calculator's error (an unbound variable is an
+    // "Undefined variable", as in a session)
+    Expected<double> evaluate();
+
+    const CompiledExpression &expression() const { return *compiled; }
+
+private:
+    std::shared_ptr<const CompiledExpression> compiled;
+    SymbolTable symbols; // variable names interned in VariableId order
+    VirtualMachine vm;
+    std::vector<double> slots; // the same values, for native code
+    size_t unbound;
+};
+
+#endif // ENGINE_H
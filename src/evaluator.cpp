@@ -1,140 +1,185 @@
 #include "evaluator.h"
+#include "mathKernels.h"
+#include "memoryTracker.h"
+#include "nodeSlots.h"
+#include "simpleStack.h"
 #include <cmath>
-#include <stdexcept>
-#include <iostream>
 
-// Constructor
-Evaluator::Evaluator(SymbolTable &st)
-    : symbols(st) {}
-
-// Main evaluation function
-double Evaluator::evaluate(const std::unique_ptr<ASTNode> &node)
+namespace
 {
-    if (!node)
-    {
-        throw std::runtime_error("Null AST node");
-    }
-
-    if (auto n = dynamic_cast<NumberNode *>(node.get()))
+    // An operation on the path from the root to the node being evaluated;
+    // 'rightSide' once its left operand is done and the right one is next
+    struct Frame
     {
-        return evalNumber(n);
+        NodeIndex index;
+        bool rightSide;
     };
 
-    if (auto v = dynamic_cast<VariableNode *>(node.get()))
-    {
-        return evalVariable(v);
-    };
+    // Reused by every evaluation on this thread
+    thread_local SimpleStack<Frame> path;
+    thread_local SimpleStack<double> leftValues; // of the frames on their right side
+    thread_local NodeSlots sharedSlots;          // slot in 'computed' of each shared node
+}
 
-    if (auto b = dynamic_cast<BinaryOpNode *>(node.get()))
-    {
-        return evalBinary(b);
-    };
+// Constructor
+Evaluator::Evaluator(SymbolTable &st, const AstArena &arena)
+    : symbols(st), nodes(arena) {}
 
-    if (auto f = dynamic_cast<UnaryFunctionNode *>(node.get()))
+// Main evaluation function: a post-order walk on explicit stacks, left
+// operand first, so the first error in evaluation order is the one
+// reported, and any depth of nesting can be evaluated
+Expected<double> Evaluator::evaluate(NodeIndex index)
+{
+    memtrack::Tag tag(memtrack::Evaluator);
+    computed.clear();
+    sharedSlots.reset(nodes.size());
+    SimpleStack<Frame> &frames = path;
+    SimpleStack<double> &lefts = leftValues;
+    frames.clear();
+    lefts.clear();
+
+    for (;;)
     {
-        return evalFunction(f);
-    };
+        // Down the left operands to the first value
+        double value;
+        Step step;
+        while ((step = evalLeaf(index, value)) == Step::Operation)
+        {
+            frames.push(Frame{index, false});
+            index = nodes[index].left;
+        }
+        if (step == Step::Failed)
+            return failure;
 
-    throw std::runtime_error("Unknown AST node type");
+        // Up through every operation that now has all its operands
+        for (;;)
+        {
+            if (frames.empty())
+                return value;
+
+            Frame &frame = frames.top();
+            const ASTNode &node = nodes[frame.index];
+            if (node.kind == NodeKind::BinaryOp && !frame.rightSide)
+            {
+                frame.rightSide = true;
+                lefts.push(value);
+                index = node.right;
+                break;
+            }
+
+            if (node.kind == NodeKind::BinaryOp)
+            {
+                if (!evalBinary(node, lefts.pop(), value, value))
+                    return failure;
+            }
+            else
+            {
+                value = evalFunction(node, value);
+            }
+            if (node.shared)
+            {
+                sharedSlots.set(frame.index, static_cast<uint32_t>(computed.size()));
+                computed.push_back(value);
+            }
+            frames.pop();
+        }
+    }
 }
 
-// Convert raw number text (binary, hex, decimal)
-double Evaluator::convertNumber(const std::string &raw) const
+// Value of a node needing no operands (or a shared node computed already),
+// or an operation still to be computed
+Evaluator::Step Evaluator::evalLeaf(NodeIndex index, double &value)
 {
+    if (index == NullNode)
+        return fail(ErrorCode::MissingOperand, NoColumn);
 
-    // Hexadecimal: 0xFF
-    if (raw.size() > 2 && raw[0] == '0' && (raw[1] == 'x' || raw[1] == 'X'))
+    const ASTNode &node = nodes[index];
+    switch (node.kind)
     {
-        return static_cast<double>(std::stoul(raw, nullptr, 16));
+    case NodeKind::Number:
+        return evalNumber(node, value);
+    case NodeKind::Variable:
+        return evalVariable(node, value);
+    case NodeKind::BinaryOp:
+    case NodeKind::Function:
+        return node.shared && findShared(index, value) ? Step::Value : Step::Operation;
     }
 
-    // Binary with 0b prefix
-    if (raw.size() > 2 && raw[0] == '0' && (raw[1] == 'b' || raw[1] == 'B'))
-    {
-        int value = 0;
-        for (char c : raw.substr(2))
-        {
-            value = value * 2 + (c - '0');
-        }
-        return static_cast<double>(value);
-    }
+    failure = Diagnostic{ErrorCode::Other, node.offset, "Unknown AST node type"};
+    return Step::Failed;
+}
 
-    // Binary: ends with 'b'
-    if (raw.size() > 1 && (raw.back() == 'b' || raw.back() == 'B'))
-    {
-        std::string digits = raw.substr(0, raw.size() - 1);
-        int value = 0;
-        for (char c : digits)
-        {
-            value = value * 2 + (c - '0');
-        }
-        return static_cast<double>(value);
-    }
+Evaluator::Step Evaluator::fail(ErrorCode code, uint32_t column, std::string_view detail)
+{
+    failure = Diagnostic{code, column, detail};
+    return Step::Failed;
+}
 
-    // Decimal fallback
-    return std::stod(raw);
+// A node with several parents (hash-consed parse) is computed once per
+// evaluate() call
+bool Evaluator::findShared(NodeIndex index, double &value) const
+{
+    uint32_t slot = sharedSlots.find(index);
+    if (slot == NoSlot)
+        return false;
+    value = computed[slot];
+    return true;
 }
 
 // Evaluate number
-double Evaluator::evalNumber(const NumberNode *n) const
+Evaluator::Step Evaluator::evalNumber(const ASTNode &n, double &value)
 {
-    // Directly return the stored value
-    return convertNumber(n->raw);
+    // Literals are converted once by the parser
+    if (n.invalid)
+    {
+        failure = nodes.error(n);
+        return Step::Failed;
+    }
+    value = n.value;
+    return Step::Value;
 }
 
 // Evaluate variable
-double Evaluator::evalVariable(const VariableNode *v) const
+Evaluator::Step Evaluator::evalVariable(const ASTNode &v, double &value)
 {
-    double value;
-    if (!symbols.get(v->name, value))
-    {
-        throw std::runtime_error("Undefined variable: " + v->name);
-    }
-    return value;
+    if (!symbols.get(v.symbol, value))
+        return fail(ErrorCode::UndefinedVariable, v.offset, symbols.name(v.symbol));
+    return Step::Value;
 }
 
 // Evaluate binary operation
-double Evaluator::evalBinary(const BinaryOpNode *b)
+bool Evaluator::evalBinary(const ASTNode &b, double left, double right, double &value)
 {
-    double left = evaluate(b->left);
-    double right = evaluate(b->right);
-
-    switch (b->op)
+    switch (b.op)
     {
     case '+':
-        return left + right;
+        value = left + right;
+        return true;
     case '-':
-        return left - right;
+        value = left - right;
+        return true;
     case '*':
-        return left * right;
+        value = left * right;
+        return true;
     case '/':
         if (right == 0)
         {
-            throw std::runtime_error("Division by zero");
+            fail(ErrorCode::DivisionByZero, b.offset);
+            return false;
         }
-        return left / right;
+        value = left / right;
+        return true;
     case '^':
-        return std::pow(left, right);
+        value = math::pow(left, right);
+        return true;
     default:
-        throw std::runtime_error(std::string("Unknown binary operator: ") + b->op);
+        fail(ErrorCode::Other, b.offset, "Unknown binary operator");
+        return false;
     }
 }
 
 // Evaluate unary function (sin, cos)
-double Evaluator::evalFunction(const UnaryFunctionNode *f)
+double Evaluator::evalFunction(const ASTNode &f, double arg) const
 {
-    double arg = evaluate(f->argument);
-
-    if (f->func == "sin")
-    {
-        return std::sin(arg);
-    }
-    else if (f->func == "cos")
-    {
-        return std::cos(arg);
-    }
-    else
-    {
-        throw std::runtime_error("Unknown function: " + f->func);
-    }
+    return f.func == FunctionId::Sin ? math::sin(arg) : math::cos(arg);
 }
@@ -1,28 +1,42 @@
 #ifndef EVALUATOR_H
 #define EVALUATOR_H
 
-#include "parser.h"
+#include "ast.h"
+#include "diagnostic.h"
 #include "symbolTable.h"
-#include <memory>
+#include <vector>
 
 class Evaluator
 {
 public:
-    explicit Evaluator(SymbolTable &st);
+    Evaluator(SymbolTable &st, const AstArena &arena);
 
-    // Evaluate any AST node
-    double evaluate(const std::unique_ptr<ASTNode> &node);
-
-    // Convert raw number text (binary, hex, decimal)
-    double convertNumber(const std::string &raw) const;
+    // Evaluate any AST node; the first error in evaluation order is
+    // returned, not thrown
+    Expected<double> evaluate(NodeIndex node);
 
 private:
     SymbolTable &symbols;
+    const AstArena &nodes;
+    std::vector<double> computed; // shared nodes evaluated so far, by slot
+    Diagnostic failure;                                 // set when a step fails
+
+    // What a node gave: a value, the need to compute its operands first, or
+    // an error (in 'failure')
+    enum class Step : uint8_t
+    {
+        Value,
+        Operation,
+        Failed
+    };
 
-    double evalNumber(const NumberNode *n) const;
-    double evalVariable(const VariableNode *v) const;
-    double evalBinary(const BinaryOpNode *b);
-    double evalFunction(const UnaryFunctionNode *f);
+    Step evalLeaf(NodeIndex index, double &value);
+    Step fail(ErrorCode code, uint32_t column, std::string_view detail = std::string_view());
+    bool findShared(NodeIndex index, double &value) const;
+    Step evalNumber(const ASTNode &n, double &value);
+    Step evalVariable(const ASTNode &v, double &value);
+    bool evalBinary(const ASTNode &b, double left, double right, double &value);
+    double evalFunction(const ASTNode &f, double arg) const;
 };
 
-#endif // EVALUATOR_H
\ No newline at end of file
+#endif // EVALUATOR_H
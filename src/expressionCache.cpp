@@ -0,0 +1,174 @@
+#include "expressionCache.h"
+#include "lexer.h"
+#include "memoryTracker.h"
+
+#include <functional>
+
+// --------------------------------------
+// CachedExpression
+// --------------------------------------
+
+CachedExpression::CachedExpression(const Program &compiled, const SymbolTable &symbols)
+    : program(compiled)
+{
+    std::vector<SymbolId> ids;
+    for (Instruction &ins : program.code)
+    {
+        if (ins.op != OpCode::LoadVar)
+            continue;
+
+        // Number the variables in order of first use
+        size_t local = 0;
+        while (local < ids.size() && ids[local] != ins.operand)
+            local++;
+        if (local == ids.size())
+        {
+            ids.push_back(ins.operand);
+            names.emplace_back(symbols.name(ins.operand));
+        }
+        ins.operand = static_cast<uint32_t>(local);
+    }
+}
+
+void CachedExpression::bind(SymbolTable &symbols, Program &out) const
+{
+    memtrack::Tag tag(memtrack::Cache);
+    // Few variables per expression: resolve them on the stack when we can
+    SymbolId small[16];
+    std::vector<SymbolId> large;
+    SymbolId *ids = small;
+    if (names.size() > 16)
+    {
+        large.resize(names.size());
+        ids = large.data();
+    }
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        ids[i] = symbols.intern(names[i]);
+    }
+
+    out.code = program.code;
+    out.constants = program.constants;
+    out.failures = program.failures;
+    out.maxStack = program.maxStack;
+    out.temps = program.temps;
+
+    for (Instruction &ins : out.code)
+    {
+        if (ins.op == OpCode::LoadVar)
+            ins.operand = ids[ins.operand];
+    }
+}
+
+bool CachedExpression::gather(const SymbolTable &symbols, double *slots) const
+{
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (!symbols.get(names[i], slots[i]))
+            return false;
+    }
+    return true;
+}
+
+const JitProgram *CachedExpression::native() const
+{
+    const JitProgram *code = published.load(std::memory_order_acquire);
+    if (code || uses.load(std::memory_order_relaxed) > JitThreshold)
+        return code;
+
+    if (uses.fetch_add(1, std::memory_order_relaxed) + 1 == JitThreshold)
+    {
+        jitted = std::make_unique<JitProgram>(program);
+        if (jitted->compiled())
+            published.store(jitted.get(), std::memory_order_release);
+    }
+    return nullptr;
+}
+
+// --------------------------------------
+// ExpressionCache
+// --------------------------------------
+
+// Fewer shards than ShardCount for a small cache; the remainder of the
+// split goes one entry each to the first shards
+ExpressionCache::ExpressionCache(size_t capacity)
+    : shardsUsed(capacity < ShardCount ? (capacity > 0 ? capacity : 1) : ShardCount),
+      totalCapacity(capacity > 0 ? capacity : 1)
+{
+    for (size_t i = 0; i < shardsUsed; i++)
+        shards[i].capacity = totalCapacity / shardsUsed + (i < totalCapacity % shardsUsed ? 1 : 0);
+}
+
+// Token type, then the operator or the lexeme text for each token.
+// Whitespace never reaches the key.
+void ExpressionCache::makeKey(std::string_view text, std::string &key)
+{
+    memtrack::Tag tag(memtrack::Cache);
+    key.clear();
+    Lexer lex(text);
+    Token t = lex.getNextToken();
+    while (t.type != TokenType::EndOfFile)
+    {
+        key += static_cast<char>('A' + static_cast<int>(t.type));
+        if (t.type == TokenType::Operator)
+        {
+            key += operatorChar(t.op);
+        }
+        else if (t.type == TokenType::Number || t.type == TokenType::Identifier ||
+                 t.type == TokenType::Function || t.type == TokenType::Unknown)
+        {
+            key += lex.lexeme(t);
+            key += '\0';
+        }
+        t = lex.getNextToken();
+    }
+}
+
+ExpressionCache::Shard &ExpressionCache::shardFor(const std::string &key)
+{
+    return shards[std::hash<std::string>()(key) % shardsUsed];
+}
+
+std::shared_ptr<const CachedExpression> ExpressionCache::find(const std::string &key)
+{
+    Shard &shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end())
+    {
+        missCount++;
+        return nullptr;
+    }
+
+    hitCount++;
+    shard.order.splice(shard.order.begin(), shard.order, it->second);
+    return it->second->second;
+}
+
+std::shared_ptr<const CachedExpression> ExpressionCache::insert(const std::string &key,
+                                                                std::shared_ptr<const CachedExpression> entry)
+{
+    memtrack::Tag tag(memtrack::Cache);
+    Shard &shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Another thread may have compiled the same expression meanwhile
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+    {
+        shard.order.splice(shard.order.begin(), shard.order, it->second);
+        return it->second->second;
+    }
+
+    shard.order.emplace_front(key, std::move(entry));
+    shard.index.emplace(key, shard.order.begin());
+
+    if (shard.order.size() > shard.capacity)
+    {
+        shard.index.erase(shard.order.back().first);
+        shard.order.pop_back();
+        evictionCount++;
+    }
+    return shard.order.front().second;
+}
@@ -0,0 +1,102 @@
+#ifndef EXPRESSION_CACHE_H
+#define EXPRESSION_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "bytecode.h"
+#include "jit.h"
+#include "symbolTable.h"
+
+// --------------------------------------
+// A compiled expression that is independent of any session: LoadVar
+// operands index 'names' instead of a session's symbol ids.
+// --------------------------------------
+struct CachedExpression
+{
+    Program program;
+    std::vector<std::string> names;
+
+    // Digits of the result if the expression is integer-only under
+    // SessionOptions::exactIntegers; empty otherwise
+    std::string exact;
+
+    // Build from a program compiled against 'symbols'
+    CachedExpression(const Program &compiled, const SymbolTable &symbols);
+
+    // Copy into 'out' with LoadVar operands rebound to ids of 'symbols'
+    void bind(SymbolTable &symbols, Program &out) const;
+
+    // Values of 'names' in 'symbols', the slot array of native(); false if
+    // one of them is undefined
+    bool gather(const SymbolTable &symbols, double *slots) const;
+
+    // Native code for the program, compiled on the JitThreshold-th call by
+    // whichever thread gets there; nullptr before that or if the program
+    // cannot be compiled
+    const JitProgram *native() const;
+
+    static constexpr uint32_t JitThreshold = 8;
+
+private:
+    mutable std::atomic<uint32_t> uses{0};
+    mutable std::atomic<const JitProgram *> published{nullptr};
+    mutable std::unique_ptr<JitProgram> jitted;
+};
+
+// --------------------------------------
+// Bounded LRU cache of compiled expressions shared by every session (and
+// every worker thread). Keys are the normalized token stream of a line, so
+// spacing differences still hit. Entries are handed out as shared_ptr, so
+// eviction never invalidates an expression that is being evaluated.
+// --------------------------------------
+class ExpressionCache
+{
+public:
+    explicit ExpressionCache(size_t capacity);
+
+    // Build the lookup key for an expression. Reuses 'key' storage.
+    static void makeKey(std::string_view text, std::string &key);
+
+    std::shared_ptr<const CachedExpression> find(const std::string &key);
+    std::shared_ptr<const CachedExpression> insert(const std::string &key,
+                                                   std::shared_ptr<const CachedExpression> entry);
+
+    uint64_t hits() const { return hitCount.load(); }
+    uint64_t misses() const { return missCount.load(); }
+    uint64_t evictions() const { return evictionCount.load(); }
+    size_t capacity() const { return totalCapacity; }
+
+private:
+    // Independent shards keep lock contention low with many workers. The
+    // capacity is split between them, so LRU order is kept per shard.
+    static constexpr size_t ShardCount = 16;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        // Most recently used at the front
+        std::list<std::pair<std::string, std::shared_ptr<const CachedExpression>>> order;
+        std::unordered_map<std::string, decltype(order)::iterator> index;
+        size_t capacity = 0;
+    };
+
+    Shard shards[ShardCount];
+    size_t shardsUsed;    // min(capacity, ShardCount)
+    size_t totalCapacity; // sum of the shard capacities
+
+    std::atomic<uint64_t> hitCount{0};
+    std::atomic<uint64_t> missCount{0};
+    std::atomic<uint64_t> evictionCount{0};
+
+    Shard &shardFor(const std::string &key);
+};
+
+#endif // EXPRESSION_CACHE_H
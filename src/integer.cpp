@@ -0,0 +1,384 @@
+#include "integer.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// --------------------------------------
+// BigInt
+// --------------------------------------
+
+BigInt::BigInt(__int128 value)
+{
+    sign = value < 0;
+    unsigned __int128 magnitude = sign ? -static_cast<unsigned __int128>(value) : static_cast<unsigned __int128>(value);
+    while (magnitude != 0)
+    {
+        limbs.push_back(static_cast<uint32_t>(magnitude));
+        magnitude >>= 32;
+    }
+}
+
+void BigInt::trim()
+{
+    while (!limbs.empty() && limbs.back() == 0)
+        limbs.pop_back();
+    if (limbs.empty())
+        sign = false;
+}
+
+size_t BigInt::bits() const
+{
+    if (limbs.empty())
+        return 0;
+    return (limbs.size() - 1) * 32 + (32 - __builtin_clz(limbs.back()));
+}
+
+bool BigInt::toInt128(__int128 &out) const
+{
+    if (limbs.size() > 4)
+        return false;
+    unsigned __int128 magnitude = 0;
+    for (size_t i = limbs.size(); i-- > 0;)
+        magnitude = magnitude << 32 | limbs[i];
+
+    // Allow -2^127, which has no positive counterpart
+    const unsigned __int128 top = static_cast<unsigned __int128>(1) << 127;
+    if (magnitude > top || (magnitude == top && !sign))
+        return false;
+    out = sign ? static_cast<__int128>(-magnitude) : static_cast<__int128>(magnitude);
+    return true;
+}
+
+int BigInt::compareMagnitude(const BigInt &a, const BigInt &b)
+{
+    if (a.limbs.size() != b.limbs.size())
+        return a.limbs.size() < b.limbs.size() ? -1 : 1;
+    for (size_t i = a.limbs.size(); i-- > 0;)
+    {
+        if (a.limbs[i] != b.limbs[i])
+            return a.limbs[i] < b.limbs[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+BigInt BigInt::addMagnitudes(const BigInt &a, const BigInt &b, bool sign)
+{
+    const BigInt &longer = a.limbs.size() >= b.limbs.size() ? a : b;
+    const BigInt &shorter = a.limbs.size() >= b.limbs.size() ? b : a;
+
+    BigInt result;
+    result.sign = sign;
+    result.limbs.resize(longer.limbs.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < longer.limbs.size(); i++)
+    {
+        uint64_t sum = carry + longer.limbs[i] + (i < shorter.limbs.size() ? shorter.limbs[i] : 0);
+        result.limbs[i] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+    result.limbs.back() = static_cast<uint32_t>(carry);
+    result.trim();
+    return result;
+}
+
+BigInt BigInt::subtractMagnitudes(const BigInt &a, const BigInt &b, bool sign)
+{
+    BigInt result;
+    result.sign = sign;
+    result.limbs.resize(a.limbs.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.limbs.size(); i++)
+    {
+        int64_t difference = static_cast<int64_t>(a.limbs[i]) - (i < b.limbs.size() ? b.limbs[i] : 0) - borrow;
+        borrow = difference < 0;
+        result.limbs[i] = static_cast<uint32_t>(difference + (borrow << 32));
+    }
+    result.trim();
+    return result;
+}
+
+BigInt operator+(const BigInt &a, const BigInt &b)
+{
+    if (a.sign == b.sign)
+        return BigInt::addMagnitudes(a, b, a.sign);
+    if (BigInt::compareMagnitude(a, b) >= 0)
+        return BigInt::subtractMagnitudes(a, b, a.sign);
+    return BigInt::subtractMagnitudes(b, a, b.sign);
+}
+
+BigInt operator-(const BigInt &a, const BigInt &b)
+{
+    BigInt negated = b;
+    negated.sign = !b.sign && !b.zero();
+    return a + negated;
+}
+
+// Schoolbook multiplication; operands are at most MaxBits long
+BigInt operator*(const BigInt &a, const BigInt &b)
+{
+    BigInt result;
+    if (a.zero() || b.zero())
+        return result;
+
+    result.sign = a.sign != b.sign;
+    result.limbs.assign(a.limbs.size() + b.limbs.size(), 0);
+    for (size_t i = 0; i < a.limbs.size(); i++)
+    {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.limbs.size(); j++)
+        {
+            uint64_t product = static_cast<uint64_t>(a.limbs[i]) * b.limbs[j] + result.limbs[i + j] + carry;
+            result.limbs[i + j] = static_cast<uint32_t>(product);
+            carry = product >> 32;
+        }
+        result.limbs[i + b.limbs.size()] = static_cast<uint32_t>(carry);
+    }
+    result.trim();
+    return result;
+}
+
+void BigInt::multiplyAdd(uint32_t factor, uint32_t addend)
+{
+    uint64_t carry = addend;
+    for (uint32_t &limb : limbs)
+    {
+        uint64_t value = static_cast<uint64_t>(limb) * factor + carry;
+        limb = static_cast<uint32_t>(value);
+        carry = value >> 32;
+    }
+    if (carry != 0)
+        limbs.push_back(static_cast<uint32_t>(carry));
+    trim();
+}
+
+std::string BigInt::toString() const
+{
+    if (limbs.empty())
+        return "0";
+
+    // Peel off nine decimal digits at a time
+    std::vector<uint32_t> magnitude = limbs;
+    std::string digits;
+    while (!magnitude.empty())
+    {
+        uint64_t remainder = 0;
+        for (size_t i = magnitude.size(); i-- > 0;)
+        {
+            uint64_t value = remainder << 32 | magnitude[i];
+            magnitude[i] = static_cast<uint32_t>(value / 1000000000);
+            remainder = value % 1000000000;
+        }
+        while (!magnitude.empty() && magnitude.back() == 0)
+            magnitude.pop_back();
+
+        for (int i = 0; i < 9 && (remainder != 0 || !magnitude.empty()); i++)
+        {
+            digits.push_back(static_cast<char>('0' + remainder % 10));
+            remainder /= 10;
+        }
+    }
+    if (sign)
+        digits.push_back('-');
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+// --------------------------------------
+// Integer
+// Each operation tries 64 bits, then 128 bits, then a BigInt.
+// --------------------------------------
+
+static bool fitsInt64(__int128 value)
+{
+    return value >= INT64_MIN && value <= INT64_MAX;
+}
+
+Integer Integer::fromBig(BigInt value)
+{
+    Integer result;
+    if (!value.toInt128(result.small))
+    {
+        result.big = true;
+        result.large = std::move(value);
+    }
+    return result;
+}
+
+bool Integer::fromLiteral(std::string_view raw, Integer &out)
+{
+    uint32_t base = 10;
+    if (raw.size() > 2 && raw[0] == '0' && (raw[1] == 'x' || raw[1] == 'X'))
+    {
+        base = 16;
+        raw.remove_prefix(2);
+    }
+    else if (raw.size() > 2 && raw[0] == '0' && (raw[1] == 'b' || raw[1] == 'B'))
+    {
+        base = 2;
+        raw.remove_prefix(2);
+    }
+    else if (raw.size() > 1 && (raw.back() == 'b' || raw.back() == 'B'))
+    {
+        base = 2;
+        raw.remove_suffix(1);
+    }
+
+    if (raw.empty())
+        return false;
+
+    // Most literals fit in 128 bits; longer ones are read again into a BigInt
+    unsigned __int128 small = 0;
+    bool overflow = false;
+    for (char c : raw)
+    {
+        uint32_t digit;
+        if (c >= '0' && c <= '9')
+            digit = static_cast<uint32_t>(c - '0');
+        else if (base == 16 && (c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+            digit = static_cast<uint32_t>((c | 0x20) - 'a' + 10);
+        else
+            return false; // decimal point
+        overflow = overflow || __builtin_mul_overflow(small, base, &small) || __builtin_add_overflow(small, digit, &small);
+    }
+
+    if (!overflow && small >> 127 == 0)
+    {
+        out = Integer();
+        out.small = static_cast<__int128>(small);
+        return true;
+    }
+
+    BigInt value;
+    for (char c : raw)
+    {
+        uint32_t digit = c <= '9' ? static_cast<uint32_t>(c - '0') : static_cast<uint32_t>((c | 0x20) - 'a' + 10);
+        value.multiplyAdd(base, digit);
+    }
+    out = fromBig(std::move(value));
+    return true;
+}
+
+Integer operator+(const Integer &a, const Integer &b)
+{
+    if (!a.big && !b.big)
+    {
+        Integer result;
+        if (fitsInt64(a.small) && fitsInt64(b.small))
+        {
+            long long sum;
+            if (!__builtin_add_overflow(static_cast<long long>(a.small), static_cast<long long>(b.small), &sum))
+                return Integer(sum);
+        }
+        if (!__builtin_add_overflow(a.small, b.small, &result.small))
+            return result;
+    }
+    return Integer::fromBig(a.toBig() + b.toBig());
+}
+
+Integer operator-(const Integer &a, const Integer &b)
+{
+    if (!a.big && !b.big)
+    {
+        Integer result;
+        if (fitsInt64(a.small) && fitsInt64(b.small))
+        {
+            long long difference;
+            if (!__builtin_sub_overflow(static_cast<long long>(a.small), static_cast<long long>(b.small), &difference))
+                return Integer(difference);
+        }
+        if (!__builtin_sub_overflow(a.small, b.small, &result.small))
+            return result;
+    }
+    return Integer::fromBig(a.toBig() - b.toBig());
+}
+
+Integer operator*(const Integer &a, const Integer &b)
+{
+    if (!a.big && !b.big)
+    {
+        Integer result;
+        if (fitsInt64(a.small) && fitsInt64(b.small))
+        {
+            long long product;
+            if (!__builtin_mul_overflow(static_cast<long long>(a.small), static_cast<long long>(b.small), &product))
+                return Integer(product);
+        }
+        if (!__builtin_mul_overflow(a.small, b.small, &result.small))
+            return result;
+    }
+    return Integer::fromBig(a.toBig() * b.toBig());
+}
+
+size_t Integer::bits() const
+{
+    if (big)
+        return large.bits();
+    unsigned __int128 magnitude = small < 0 ? -static_cast<unsigned __int128>(small) : static_cast<unsigned __int128>(small);
+    size_t count = 0;
+    while (magnitude != 0)
+    {
+        count++;
+        magnitude >>= 1;
+    }
+    return count;
+}
+
+bool Integer::power(const Integer &base, const Integer &exponent, Integer &out)
+{
+    if (exponent.big || exponent.small < 0)
+        return false;
+
+    // 0, 1 and -1 stay small for any exponent
+    if (!base.big && (base.small == 0 || base.small == 1 || base.small == -1))
+    {
+        bool odd = (exponent.small & 1) != 0;
+        if (base.small == 0)
+            out = Integer(exponent.small == 0 ? 1 : 0);
+        else
+            out = Integer(base.small == -1 && odd ? -1 : 1);
+        return true;
+    }
+
+    // |base| >= 2, so the result has at least 'exponent' bits
+    if (exponent.small > static_cast<__int128>(MaxBits) ||
+        (base.bits() - 1) * static_cast<size_t>(exponent.small) > MaxBits)
+        return false;
+
+    Integer result(1);
+    Integer square = base;
+    for (__int128 e = exponent.small; e != 0; e >>= 1)
+    {
+        if (e & 1)
+            result = result * square;
+        if (e > 1)
+            square = square * square;
+    }
+    out = std::move(result);
+    return true;
+}
+
+double Integer::toDouble() const
+{
+    // Both conversions round to nearest
+    if (!big)
+        return static_cast<double>(small);
+    return std::strtod(large.toString().c_str(), nullptr);
+}
+
+std::string Integer::toString() const
+{
+    if (big)
+        return large.toString();
+
+    unsigned __int128 magnitude = small < 0 ? -static_cast<unsigned __int128>(small) : static_cast<unsigned __int128>(small);
+    char digits[48];
+    char *start = digits + sizeof(digits);
+    do
+    {
+        *--start = static_cast<char>('0' + static_cast<int>(magnitude % 10));
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (small < 0)
+        *--start = '-';
+    return std::string(start, digits + sizeof(digits));
+}
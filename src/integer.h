@@ -0,0 +1,121 @@
+#ifndef INTEGER_H
+#define INTEGER_H
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// --------------------------------------
+// Arbitrary precision integer: sign and magnitude, 32-bit limbs with the
+// least significant first. Only what exact evaluation needs.
+// --------------------------------------
+class BigInt
+{
+public:
+    BigInt() = default;
+    explicit BigInt(__int128 value);
+
+    bool negative() const { return sign; }
+    bool zero() const { return limbs.empty(); }
+
+    // Number of significant bits of the magnitude
+    size_t bits() const;
+
+    // The value if it fits in __int128
+    bool toInt128(__int128 &out) const;
+
+    friend BigInt operator+(const BigInt &a, const BigInt &b);
+    friend BigInt operator-(const BigInt &a, const BigInt &b);
+    friend BigInt operator*(const BigInt &a, const BigInt &b);
+
+    // Magnitude = magnitude * factor + addend
+    void multiplyAdd(uint32_t factor, uint32_t addend);
+
+    std::string toString() const;
+
+private:
+    bool sign = false;
+    std::vector<uint32_t> limbs;
+
+    static int compareMagnitude(const BigInt &a, const BigInt &b);
+    static BigInt addMagnitudes(const BigInt &a, const BigInt &b, bool sign);
+    static BigInt subtractMagnitudes(const BigInt &a, const BigInt &b, bool sign); // |a| >= |b|
+    void trim();
+};
+
+// --------------------------------------
+// Exact integer for the typed evaluation mode. Values live in an __int128;
+// operations on values that fit in 64 bits use 64-bit arithmetic, and a
+// result that overflows 128 bits moves to a BigInt.
+// --------------------------------------
+class Integer
+{
+public:
+    Integer() = default;
+    Integer(long long value) : small(value) {}
+
+    // Value of an integer literal (hex, binary or decimal digits); false
+    // for anything else, e.g. "1.5". Binary digits are weighted exactly as
+    // convertNumber weights them, without its 32-bit wrap.
+    static bool fromLiteral(std::string_view raw, Integer &out);
+
+    friend Integer operator+(const Integer &a, const Integer &b);
+    friend Integer operator-(const Integer &a, const Integer &b);
+    friend Integer operator*(const Integer &a, const Integer &b);
+
+    // Exponentiation by squaring; false if the exponent is negative or the
+    // result would exceed MaxBits (the caller falls back to double)
+    static bool power(const Integer &base, const Integer &exponent, Integer &out);
+
+    // Largest result power() builds, in bits
+    static constexpr size_t MaxBits = 1 << 16;
+
+    // Nearest double (round to nearest even)
+    double toDouble() const;
+
+    // Decimal text, the way formatDouble prints an integral value
+    std::string toString() const;
+
+private:
+    bool big = false;
+    __int128 small = 0;
+    BigInt large;
+
+    BigInt toBig() const { return big ? large : BigInt(small); }
+    static Integer fromBig(BigInt value);
+    size_t bits() const;
+};
+
+// a ^ b without calling pow() when a is a non-zero integer, b a small
+// non-negative integer and the result fits in 53 bits: the product is then
+// exact, which is also what std::pow returns for it
+inline double power(double base, double exponent)
+{
+    if (exponent >= 0 && exponent <= 64 && base != 0 && base >= -(1LL << 53) && base <= (1LL << 53))
+    {
+        long long e = static_cast<long long>(exponent);
+        long long b = static_cast<long long>(base);
+        if (static_cast<double>(e) == exponent && static_cast<double>(b) == base)
+        {
+            const long long limit = 1LL << 53;
+            long long result = 1;
+            bool exact = true;
+            while (exact)
+            {
+                if (e & 1)
+                    exact = !__builtin_mul_overflow(result, b, &result) && result >= -limit && result <= limit;
+                e >>= 1;
+                if (e == 0)
+                    break;
+                exact = exact && !__builtin_mul_overflow(b, b, &b) && b <= limit;
+            }
+            if (exact)
+                return static_cast<double>(result);
+        }
+    }
+    return std::pow(base, exponent);
+}
+
+#endif // INTEGER_H
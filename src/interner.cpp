@@ -0,0 +1,73 @@
+#include "interner.h"
+#include "memoryTracker.h"
+
+// FNV-1a
+uint32_t Interner::hash(std::string_view s)
+{
+    uint32_t h = 2166136261u;
+    for (char c : s)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Bucket holding 'name', or the empty bucket where it would go
+size_t Interner::findBucket(std::string_view name, uint32_t h) const
+{
+    size_t mask = buckets.size() - 1;
+    size_t i = h & mask;
+    while (buckets[i] != 0 && this->name(buckets[i] - 1) != name)
+    {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+uint32_t Interner::find(std::string_view name) const
+{
+    if (buckets.empty())
+        return NotFound;
+
+    size_t i = findBucket(name, hash(name));
+    return buckets[i] == 0 ? NotFound : buckets[i] - 1;
+}
+
+uint32_t Interner::intern(std::string_view name)
+{
+    memtrack::Tag tag(memtrack::Symbols);
+    // Keep the table at most half full
+    if ((size() + 1) * 2 > buckets.size())
+        grow();
+
+    size_t i = findBucket(name, hash(name));
+    if (buckets[i] != 0)
+        return buckets[i] - 1;
+
+    uint32_t id = static_cast<uint32_t>(size());
+    pool.append(name.data(), name.size());
+    offsets.push_back(static_cast<uint32_t>(pool.size()));
+    buckets[i] = id + 1;
+    return id;
+}
+
+void Interner::grow()
+{
+    std::vector<uint32_t> old;
+    old.swap(buckets);
+    buckets.assign(old.empty() ? 16 : old.size() * 2, 0);
+
+    for (uint32_t entry : old)
+    {
+        if (entry != 0)
+            buckets[findBucket(name(entry - 1), hash(name(entry - 1)))] = entry;
+    }
+}
+
+void Interner::clear()
+{
+    pool.clear();
+    offsets.assign(1, 0);
+    buckets.clear();
+}
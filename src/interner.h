@@ -0,0 +1,42 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Maps identifier strings to dense integer ids (0, 1, 2, ...).
+// Names are stored back to back in one pool and found through an
+// open-addressing hash table, so lookups never build a std::string.
+class Interner
+{
+public:
+    static constexpr uint32_t NotFound = UINT32_MAX;
+
+    // Id of 'name', adding it if it is new
+    uint32_t intern(std::string_view name);
+
+    // Id of 'name', or NotFound
+    uint32_t find(std::string_view name) const;
+
+    std::string_view name(uint32_t id) const
+    {
+        return std::string_view(pool.data() + offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+    size_t size() const { return offsets.size() - 1; }
+
+    void clear();
+
+private:
+    std::string pool;
+    std::vector<uint32_t> offsets{0}; // name i is pool[offsets[i], offsets[i+1])
+    std::vector<uint32_t> buckets;    // id + 1, or 0 for an empty bucket
+
+    static uint32_t hash(std::string_view s);
+    size_t findBucket(std::string_view name, uint32_t h) const;
+    void grow();
+};
+
+#endif // INTERNER_H
@@ -0,0 +1,361 @@
+#include "jit.h"
+#include "mathKernels.h"
+#include "memoryTracker.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define CALC_JIT 1
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef CALC_JIT
+
+namespace
+{
+    // Stack slot i lives in xmm(FirstSlot + i); xmm0 and xmm1 are scratch
+    // registers and carry the arguments and result of math calls
+    const int FirstSlot = 2;
+    const size_t MaxSlots = 16 - FirstSlot;
+
+    // Registers of the generated function
+    const int Rbx = 3;  // slots
+    const int Rsp = 4;
+    const int R12 = 12; // constants
+    const int R13 = 13; // result
+
+    // Spill area for values that must survive a call to a math function
+    const int32_t FrameSize = static_cast<int32_t>(MaxSlots * sizeof(double));
+
+    // Minimal x86-64 encoder for the handful of instructions we need
+    class Assembler
+    {
+    public:
+        std::vector<uint8_t> code;
+
+        void byte(uint8_t b) { code.push_back(b); }
+
+        void bytes(std::initializer_list<uint8_t> list)
+        {
+            code.insert(code.end(), list);
+        }
+
+        void imm32(int32_t value)
+        {
+            uint8_t raw[4];
+            std::memcpy(raw, &value, sizeof(raw));
+            code.insert(code.end(), raw, raw + sizeof(raw));
+        }
+
+        void imm64(uint64_t value)
+        {
+            uint8_t raw[8];
+            std::memcpy(raw, &value, sizeof(raw));
+            code.insert(code.end(), raw, raw + sizeof(raw));
+        }
+
+        // prefix [REX] 0F op ModRM: SSE instruction between two xmm registers
+        void sse(uint8_t prefix, uint8_t op, int reg, int rm)
+        {
+            byte(prefix);
+            rex(reg, rm);
+            bytes({0x0F, op, static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7))});
+        }
+
+        // prefix [REX] 0F op ModRM [SIB] disp32: xmm register and [base + disp]
+        void sseMemory(uint8_t prefix, uint8_t op, int reg, int base, int32_t disp)
+        {
+            byte(prefix);
+            rex(reg, base);
+            bytes({0x0F, op, static_cast<uint8_t>(0x80 | (reg & 7) << 3 | (base & 7))});
+            if ((base & 7) == Rsp)
+                byte(0x24);
+            imm32(disp);
+        }
+
+        void movsdLoad(int xmm, int base, int32_t disp) { sseMemory(0xF2, 0x10, xmm, base, disp); }
+        void movsdStore(int base, int32_t disp, int xmm) { sseMemory(0xF2, 0x11, xmm, base, disp); }
+        void movapd(int to, int from) { sse(0x66, 0x28, to, from); }
+
+        void call(const void *function)
+        {
+            uint64_t address;
+            std::memcpy(&address, &function, sizeof(address));
+            bytes({0x48, 0xB8}); // mov rax, imm64
+            imm64(address);
+            bytes({0xFF, 0xD0}); // call rax
+        }
+
+        // Jump with a 32-bit displacement patched by bind()
+        size_t jump(std::initializer_list<uint8_t> opcode)
+        {
+            bytes(opcode);
+            imm32(0);
+            return code.size();
+        }
+
+        void bind(size_t jumpEnd, size_t target)
+        {
+            int32_t disp = static_cast<int32_t>(target) - static_cast<int32_t>(jumpEnd);
+            std::memcpy(code.data() + jumpEnd - 4, &disp, sizeof(disp));
+        }
+
+    private:
+        void rex(int reg, int rm)
+        {
+            if (reg > 7 || rm > 7)
+                byte(static_cast<uint8_t>(0x40 | (reg > 7) << 2 | (rm > 7)));
+        }
+    };
+
+    // Executable memory shared by many programs, so that hot code sits close
+    // together instead of one page per program. Every chunk is mapped twice,
+    // writable for the compiler and executable for callers, so new code can
+    // be appended while other threads run code from the same chunk. A chunk
+    // is unmapped once it is full and all its programs are gone.
+    class CodeArena
+    {
+    public:
+        static const size_t ChunkSize = 64 * 1024;
+
+        struct Chunk
+        {
+            char *writable = nullptr;
+            char *executable = nullptr;
+            size_t used = 0;
+            size_t live = 0;
+        };
+
+        // Copy 'code' into executable memory; nullptr if that failed
+        static const void *add(const std::vector<uint8_t> &code, Chunk *&owner)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t size = (code.size() + 15) & ~size_t(15);
+            if (size > ChunkSize)
+                return nullptr;
+            if (!current || current->used + size > ChunkSize)
+            {
+                Chunk *fresh = map();
+                if (!fresh)
+                    return nullptr;
+                retire(current);
+                current = fresh;
+            }
+            std::memcpy(current->writable + current->used, code.data(), code.size());
+            const void *entry = current->executable + current->used;
+            current->used += size;
+            current->live++;
+            owner = current;
+            return entry;
+        }
+
+        static void release(Chunk *chunk)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            chunk->live--;
+            if (chunk != current && chunk->live == 0)
+                unmap(chunk);
+        }
+
+    private:
+        static std::mutex mutex;
+        static Chunk *current; // chunk being filled
+
+        static Chunk *map()
+        {
+            int fd = memfd_create("calc-jit", MFD_CLOEXEC);
+            if (fd < 0)
+                return nullptr;
+            Chunk *chunk = nullptr;
+            if (ftruncate(fd, ChunkSize) == 0)
+            {
+                void *w = mmap(nullptr, ChunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                void *x = mmap(nullptr, ChunkSize, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+                if (w != MAP_FAILED && x != MAP_FAILED)
+                {
+                    chunk = new Chunk;
+                    chunk->writable = static_cast<char *>(w);
+                    chunk->executable = static_cast<char *>(x);
+                }
+                else
+                {
+                    if (w != MAP_FAILED)
+                        munmap(w, ChunkSize);
+                    if (x != MAP_FAILED)
+                        munmap(x, ChunkSize);
+                }
+            }
+            close(fd);
+            return chunk;
+        }
+
+        static void retire(Chunk *chunk)
+        {
+            if (chunk && chunk->live == 0)
+                unmap(chunk);
+        }
+
+        static void unmap(Chunk *chunk)
+        {
+            munmap(chunk->writable, ChunkSize);
+            munmap(chunk->executable, ChunkSize);
+            delete chunk;
+        }
+    };
+
+    std::mutex CodeArena::mutex;
+    CodeArena::Chunk *CodeArena::current = nullptr;
+
+    int slot(size_t depth) { return FirstSlot + static_cast<int>(depth); }
+
+    // Save the live values below 'depth' around a math call
+    void spill(Assembler &a, size_t depth)
+    {
+        for (size_t i = 0; i < depth; i++)
+            a.movsdStore(Rsp, static_cast<int32_t>(i * sizeof(double)), slot(i));
+    }
+
+    void reload(Assembler &a, size_t depth)
+    {
+        for (size_t i = 0; i < depth; i++)
+            a.movsdLoad(slot(i), Rsp, static_cast<int32_t>(i * sizeof(double)));
+    }
+
+    bool translate(const Program &program, Assembler &a)
+    {
+        if (program.maxStack == 0 || program.maxStack > MaxSlots)
+            return false;
+
+        // Prologue: keep the arguments in callee-saved registers
+        a.bytes({0x53});             // push rbx
+        a.bytes({0x41, 0x54});       // push r12
+        a.bytes({0x41, 0x55});       // push r13
+        a.bytes({0x48, 0x89, 0xFB}); // mov rbx, rdi
+        a.bytes({0x49, 0x89, 0xF4}); // mov r12, rsi
+        a.bytes({0x49, 0x89, 0xD5}); // mov r13, rdx
+        a.bytes({0x48, 0x81, 0xEC}); // sub rsp, FrameSize
+        a.imm32(FrameSize);
+
+        std::vector<size_t> failJumps;
+        size_t depth = 0;
+        for (const Instruction &ins : program.code)
+        {
+            int32_t offset = static_cast<int32_t>(ins.operand * sizeof(double));
+            switch (ins.op)
+            {
+            case OpCode::PushConst:
+                a.movsdLoad(slot(depth++), R12, offset);
+                break;
+            case OpCode::LoadVar:
+                a.movsdLoad(slot(depth++), Rbx, offset);
+                break;
+            case OpCode::Add:
+                depth--;
+                a.sse(0xF2, 0x58, slot(depth - 1), slot(depth));
+                break;
+            case OpCode::Sub:
+                depth--;
+                a.sse(0xF2, 0x5C, slot(depth - 1), slot(depth));
+                break;
+            case OpCode::Mul:
+                depth--;
+                a.sse(0xF2, 0x59, slot(depth - 1), slot(depth));
+                break;
+            case OpCode::Div:
+                // Same test as the interpreter: fail if the divisor
+                // compares equal to zero (NaN divides normally)
+                depth--;
+                a.sse(0x66, 0x57, 0, 0);              // xorpd xmm0, xmm0
+                a.sse(0x66, 0x2E, slot(depth), 0);    // ucomisd divisor, xmm0
+                a.bytes({0x7A, 0x06});                // jp over the je
+                failJumps.push_back(a.jump({0x0F, 0x84})); // je fail
+                a.sse(0xF2, 0x5E, slot(depth - 1), slot(depth));
+                break;
+            case OpCode::Pow:
+                depth--;
+                spill(a, depth - 1);
+                a.movapd(0, slot(depth - 1));
+                a.movapd(1, slot(depth));
+                a.call(reinterpret_cast<const void *>(math::functions().pow));
+                reload(a, depth - 1);
+                a.movapd(slot(depth - 1), 0);
+                break;
+            case OpCode::Sin:
+            case OpCode::Cos:
+                spill(a, depth - 1);
+                a.movapd(0, slot(depth - 1));
+                a.call(reinterpret_cast<const void *>(ins.op == OpCode::Sin ? math::functions().sin
+                                                                            : math::functions().cos));
+                reload(a, depth - 1);
+                a.movapd(slot(depth - 1), 0);
+                break;
+            case OpCode::Fail:
+            case OpCode::StoreTemp: // shared subexpressions stay on the interpreter
+            case OpCode::LoadTemp:
+                return false;
+            }
+        }
+
+        a.movsdStore(R13, 0, slot(0));
+        a.bytes({0x31, 0xC0}); // xor eax, eax
+        size_t done = a.jump({0xE9});
+
+        size_t fail = a.code.size();
+        a.bytes({0xB8, 0x01, 0x00, 0x00, 0x00}); // mov eax, 1
+        for (size_t j : failJumps)
+            a.bind(j, fail);
+
+        // Epilogue
+        a.bind(done, a.code.size());
+        a.bytes({0x48, 0x81, 0xC4}); // add rsp, FrameSize
+        a.imm32(FrameSize);
+        a.bytes({0x41, 0x5D}); // pop r13
+        a.bytes({0x41, 0x5C}); // pop r12
+        a.bytes({0x5B});       // pop rbx
+        a.bytes({0xC3});       // ret
+        return true;
+    }
+}
+
+JitProgram::JitProgram(const Program &program)
+    : constants(program.constants)
+{
+    memtrack::Tag tag(memtrack::Compiler);
+    Assembler a;
+    if (!translate(program, a))
+        return;
+
+    CodeArena::Chunk *chunk = nullptr;
+    const void *code = CodeArena::add(a.code, chunk);
+    if (!code)
+        return;
+    memory = chunk;
+    entry = reinterpret_cast<Entry>(const_cast<void *>(code));
+}
+
+JitProgram::~JitProgram()
+{
+    if (memory)
+        CodeArena::release(static_cast<CodeArena::Chunk *>(memory));
+}
+
+bool JitProgram::supported()
+{
+    return true;
+}
+
+#else
+
+JitProgram::JitProgram(const Program &) {}
+
+JitProgram::~JitProgram() {}
+
+bool JitProgram::supported()
+{
+    return false;
+}
+
+#endif
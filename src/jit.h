@@ -0,0 +1,52 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bytecode.h"
+
+// --------------------------------------
+// Native x86-64 code for one Program (System V ABI, SSE2).
+// The tape is translated into straight-line code: the value stack lives in
+// xmm registers, variables are loaded from a slot array indexed by the
+// LoadVar operands, and sin/cos/pow call the functions of the selected
+// math tier (mathKernels.h) like the interpreter, so results are
+// bit-for-bit identical.
+//
+// Compiled code only reports that something went wrong; callers run the
+// interpreter again to get the exact error. Programs that always fail,
+// need more stack than there are registers, or run on another platform
+// are not compiled (compiled() is false) and stay on the interpreter.
+// --------------------------------------
+class JitProgram
+{
+public:
+    explicit JitProgram(const Program &program);
+    ~JitProgram();
+
+    JitProgram(const JitProgram &) = delete;
+    JitProgram &operator=(const JitProgram &) = delete;
+
+    // True if this build can generate native code at all
+    static bool supported();
+
+    bool compiled() const { return entry != nullptr; }
+
+    // Evaluate with variable 'i' read from slots[i]; every slot the program
+    // loads must hold a defined value. Returns false on division by zero.
+    bool run(const double *slots, double &result) const
+    {
+        return entry(slots, constants.data(), &result) == 0;
+    }
+
+private:
+    using Entry = int (*)(const double *slots, const double *constants, double *result);
+
+    Entry entry = nullptr;
+    void *memory = nullptr; // code arena chunk holding 'entry'
+    std::vector<double> constants;
+};
+
+#endif // JIT_H
@@ -1,9 +1,89 @@
 #include "lexer.h"
-#include <iostream>
-#include <cctype>
+#include "memoryTracker.h"
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+
+// --------------------------------------
+// Character classes (one table lookup per character)
+// --------------------------------------
+namespace
+{
+    enum CharClass : uint8_t
+    {
+        Space = 1 << 0,
+        Digit = 1 << 1,
+        Alpha = 1 << 2,
+        HexDigit = 1 << 3,
+        OperatorChar = 1 << 4
+    };
+
+    constexpr std::array<uint8_t, 256> buildCharTable()
+    {
+        std::array<uint8_t, 256> t{};
+        for (const char c : {' ', '\t', '\n', '\v', '\f', '\r'})
+            t[static_cast<unsigned char>(c)] |= Space;
+        for (int c = '0'; c <= '9'; c++)
+            t[c] |= Digit | HexDigit;
+        for (int c = 'a'; c <= 'z'; c++)
+            t[c] |= Alpha;
+        for (int c = 'A'; c <= 'Z'; c++)
+            t[c] |= Alpha;
+        for (int c = 'a'; c <= 'f'; c++)
+            t[c] |= HexDigit;
+        for (int c = 'A'; c <= 'F'; c++)
+            t[c] |= HexDigit;
+        for (const char c : {'+', '-', '*', '/', '^'})
+            t[static_cast<unsigned char>(c)] |= OperatorChar;
+        return t;
+    }
+
+    constexpr std::array<uint8_t, 256> charTable = buildCharTable();
+
+    inline bool is(char c, uint8_t cls)
+    {
+        return (charTable[static_cast<unsigned char>(c)] & cls) != 0;
+    }
+
+    Operator operatorFor(char c)
+    {
+        switch (c)
+        {
+        case '+':
+            return Operator::Plus;
+        case '-':
+            return Operator::Minus;
+        case '*':
+            return Operator::Star;
+        case '/':
+            return Operator::Slash;
+        default:
+            return Operator::Caret;
+        }
+    }
+}
+
+char operatorChar(Operator op)
+{
+    switch (op)
+    {
+    case Operator::Plus:
+        return '+';
+    case Operator::Minus:
+        return '-';
+    case Operator::Star:
+        return '*';
+    case Operator::Slash:
+        return '/';
+    case Operator::Caret:
+        return '^';
+    default:
+        return '?';
+    }
+}
 
 // Constructor
-Lexer::Lexer(const std::string &input)
+Lexer::Lexer(std::string_view input)
     : text(input), pos(0) {}
 
 // Reset lexer to start scanning from beginning
@@ -28,59 +108,66 @@ char Lexer::get()
     return text[pos++];
 }
 
+// Token spanning from 'start' to the current position
+Token Lexer::makeToken(TokenType type, size_t start, Operator op) const
+{
+    return Token{type, op, static_cast<uint32_t>(start), static_cast<uint32_t>(pos - start)};
+}
+
 // --------------------------------------
 // Main tokenizing function
 Token Lexer::getNextToken()
 {
+    memtrack::Tag tag(memtrack::Lexer);
     // Skip whitespace
-    while (isspace(peek()))
+    while (is(peek(), Space))
         get();
 
+    size_t start = pos;
     char c = peek();
     if (c == '\0')
-        return Token{TokenType::EndOfFile, ""};
+        return makeToken(TokenType::EndOfFile, start);
 
     // Parentheses
     if (c == '(')
     {
         get();
-        return Token{TokenType::LParen, "("};
+        return makeToken(TokenType::LParen, start);
     }
     if (c == ')')
     {
         get();
-        return Token{TokenType::RParen, ")"};
+        return makeToken(TokenType::RParen, start);
     }
 
     // Assignment
     if (c == '=')
     {
         get();
-        return Token{TokenType::Assign, "="};
+        return makeToken(TokenType::Assign, start);
     }
 
     // Operators
-    if (c == '+' || c == '-' || c == '*' || c == '/' || c == '^')
+    if (is(c, OperatorChar))
     {
         get();
-        std::string s(1, c);
-        return Token{TokenType::Operator, s};
+        return makeToken(TokenType::Operator, start, operatorFor(c));
     }
 
     // Numbers literal
     //(decimal, hex 0x, binary ending in b)
 
-    if (isdigit(c) || c == '0')
+    if (is(c, Digit))
         return numberToken();
 
     // Identifiers or Functions
     //  (sin and cos only)
-    if (isalpha(c))
+    if (is(c, Alpha))
         return identifierOrFunction();
 
     // Unknown character
     get();
-    return Token{TokenType::Unknown, std::string(1, c)};
+    return makeToken(TokenType::Unknown, start);
 }
 // Parse number token:
 // - decimal: 123, 45.67
@@ -88,36 +175,34 @@ Token Lexer::getNextToken()
 // - binary ending in b: 1101b, 101b
 Token Lexer::numberToken()
 {
-    std::string value;
+    size_t start = pos;
 
     // Hexadecimal?
     if (peek() == '0' && (pos + 1 < text.size()) && (text[pos + 1] == 'x' || text[pos + 1] == 'X'))
     {
-        value += get(); // '0'
-        value += get(); // 'x'
-        while (isxdigit(peek()))
+        pos += 2; // "0x"
+        while (is(peek(), HexDigit))
         {
-            value += get();
+            get();
         }
-        return Token{TokenType::Number, value};
+        return makeToken(TokenType::Number, start);
     }
 
     // Binary with 0b/0B prefix (tolerated for robustness)
     if (peek() == '0' && (pos + 1 < text.size()) && (text[pos + 1] == 'b' || text[pos + 1] == 'B'))
     {
-        value += get(); // '0'
-        value += get(); // 'b'
+        pos += 2; // "0b"
         while (peek() == '0' || peek() == '1')
         {
-            value += get();
+            get();
         }
-        return Token{TokenType::Number, value};
+        return makeToken(TokenType::Number, start);
     }
 
     // Read digits (decimal or binary before checking binary suffix)
-    while (isdigit(peek()))
+    while (is(peek(), Digit))
     {
-        value += get();
+        get();
     }
 
     // Optional decimal part
@@ -125,40 +210,122 @@ Token Lexer::numberToken()
     if (peek() == '.')
     {
         hasDot = true;
-        value += get(); // '.'
-        while (isdigit(peek()))
+        get(); // '.'
+        while (is(peek(), Digit))
         {
-            value += get();
+            get();
         }
     }
 
     // Binary ends with 'b'
-    if (!hasDot && (peek() == 'b' || peek() == 'B') && !value.empty())
+    if (!hasDot && (peek() == 'b' || peek() == 'B') && pos > start)
     {
-        value += get(); // append 'b'
-        return Token{TokenType::Number, value};
+        get(); // append 'b'
+        return makeToken(TokenType::Number, start);
     }
 
     // Decimal number
-    return Token{TokenType::Number, value};
+    return makeToken(TokenType::Number, start);
 }
 
 // Parse identifier or function token
 // - functions: sin, cos
 Token Lexer::identifierOrFunction()
 {
-    std::string name;
+    size_t start = pos;
 
-    while (isalpha(peek()))
+    while (is(peek(), Alpha))
     {
-        name += get();
+        get();
     }
 
     // Check if it's a function
+    std::string_view name = text.substr(start, pos - start);
     if (name == "sin" || name == "cos")
     {
-        return Token{TokenType::Function, name};
+        return makeToken(TokenType::Function, start);
+    }
+
+    return makeToken(TokenType::Identifier, start);
+}
+
+// Accumulate binary digits the way the original int loop did
+// (any decimal digit is weighted by 2, overflow wraps).
+static double binaryValue(std::string_view digits)
+{
+    unsigned int value = 0;
+    for (char c : digits)
+    {
+        value = value * 2 + static_cast<unsigned int>(c - '0');
+    }
+    return static_cast<double>(static_cast<int>(value));
+}
+
+// Convert raw number text (binary, hex, decimal)
+Expected<double> convertNumber(std::string_view raw)
+{
+
+    // Hexadecimal: 0xFF (same range as std::stoul)
+    if (raw.size() > 2 && raw[0] == '0' && (raw[1] == 'x' || raw[1] == 'X'))
+    {
+        unsigned long value = 0;
+        for (char c : raw.substr(2))
+        {
+            unsigned long digit = is(c, Digit) ? c - '0' : (c | 0x20) - 'a' + 10;
+            if (value > (~0UL - digit) / 16)
+            {
+                return Diagnostic{ErrorCode::InvalidNumber, NoColumn, "stoul"};
+            }
+            value = value * 16 + digit;
+        }
+        return static_cast<double>(value);
+    }
+
+    // Binary with 0b prefix
+    if (raw.size() > 2 && raw[0] == '0' && (raw[1] == 'b' || raw[1] == 'B'))
+    {
+        return binaryValue(raw.substr(2));
     }
 
-    return Token{TokenType::Identifier, name};
+    // Binary: ends with 'b'
+    if (raw.size() > 1 && (raw.back() == 'b' || raw.back() == 'B'))
+    {
+        return binaryValue(raw.substr(0, raw.size() - 1));
+    }
+
+    // Decimal fallback (strtod needs a terminated copy; short ones stay on the stack)
+    char small[64];
+    std::string large;
+    const char *str;
+    if (raw.size() < sizeof(small))
+    {
+        raw.copy(small, raw.size());
+        small[raw.size()] = '\0';
+        str = small;
+    }
+    else
+    {
+        large.assign(raw);
+        str = large.c_str();
+    }
+
+    // Same checks std::stod performs
+    char *end;
+    errno = 0;
+    double value = std::strtod(str, &end);
+    if (end == str)
+    {
+        return Diagnostic{ErrorCode::InvalidNumber, NoColumn, "stod"};
+    }
+    if (errno == ERANGE)
+    {
+        return Diagnostic{ErrorCode::InvalidNumber, NoColumn, "stod"};
+    }
+    return value;
+}
+
+std::string_view literalAt(std::string_view text, uint32_t offset)
+{
+    Lexer lex(text.substr(offset));
+    return lex.lexeme(lex.getNextToken());
 }
@@ -1,14 +1,16 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <cstdint>
 #include <string>
-#include <vector>
-#include <cctype>
+#include <string_view>
+
+#include "diagnostic.h"
 
 // --------------------------------------
 // Token Types
 // --------------------------------------
-enum class TokenType
+enum class TokenType : uint8_t
 {
     Number,     // 10, 0x1F, 1100b
     Identifier, // variable names: a, radius, pi
@@ -22,13 +24,30 @@ enum class TokenType
     Unknown
 };
 
+// Operator tokens carry one of these instead of their text
+enum class Operator : uint8_t
+{
+    None,
+    Plus,  // +
+    Minus, // -
+    Star,  // *
+    Slash, // /
+    Caret  // ^
+};
+
+// Character used for an operator in the AST and in messages
+char operatorChar(Operator op);
+
 // --------------------------------------
 // Token Structure
+// The text is not copied: offset/length locate it in the lexer input.
 // --------------------------------------
 struct Token
 {
     TokenType type;
-    std::string lexeme; // actual text
+    Operator op;     // which operator, for TokenType::Operator
+    uint32_t offset; // start of the lexeme in the input
+    uint32_t length; // lexeme length
 };
 
 // --------------------------------------
@@ -37,20 +56,39 @@ struct Token
 class Lexer
 {
 public:
-    explicit Lexer(const std::string &input);
+    // The input is borrowed, it must outlive the lexer
+    explicit Lexer(std::string_view input);
 
     Token getNextToken();
     void reset();
 
+    // Text of a token produced by this lexer
+    std::string_view lexeme(const Token &t) const
+    {
+        return text.substr(t.offset, t.length);
+    }
+
+    std::string_view input() const { return text; }
+
 private:
-    std::string text;
+    std::string_view text;
     size_t pos;
 
     char peek() const;
     char get();
 
+    Token makeToken(TokenType type, size_t start, Operator op = Operator::None) const;
     Token numberToken();
     Token identifierOrFunction();
 };
 
+// Convert a number lexeme (binary, hex, decimal) to its value, or an
+// InvalidNumber diagnostic ("stoul" / "stod", as std::stoul and std::stod
+// would have thrown) if the text cannot be converted.
+Expected<double> convertNumber(std::string_view raw);
+
+// Text of the number token that starts at 'offset' in 'text' (where a
+// Number node's literal came from)
+std::string_view literalAt(std::string_view text, uint32_t offset);
+
 #endif // LEXER_H
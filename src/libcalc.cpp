@@ -0,0 +1,123 @@
+#include "libcalc.h"
+#include "engine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+static_assert(CALC_EXPECTED_PAREN == static_cast<int>(ErrorCode::ExpectedParen) &&
+                  CALC_MISSING_OPERAND == static_cast<int>(ErrorCode::MissingOperand) &&
+                  CALC_DIVISION_BY_ZERO == static_cast<int>(ErrorCode::DivisionByZero) &&
+                  CALC_OTHER_ERROR == static_cast<int>(ErrorCode::Other),
+              "libcalc.h error codes follow ErrorCode");
+
+struct calc_expression
+{
+    std::shared_ptr<const CompiledExpression> compiled;
+};
+
+struct calc_context
+{
+    explicit calc_context(std::shared_ptr<const CompiledExpression> compiled) : context(std::move(compiled)) {}
+
+    EvaluationContext context;
+};
+
+// Code, column and message (truncated to fit) of 'error'
+static int report(const Diagnostic &error, calc_error *out)
+{
+    if (out)
+    {
+        out->code = static_cast<int>(error.code);
+        out->column = error.column;
+        std::string_view prefix = error.prefix();
+        size_t n = std::min(prefix.size(), sizeof(out->message) - 1);
+        std::memcpy(out->message, prefix.data(), n);
+        size_t m = std::min(error.detail.size(), sizeof(out->message) - 1 - n);
+        std::memcpy(out->message + n, error.detail.data(), m);
+        out->message[n + m] = '\0';
+    }
+    return static_cast<int>(error.code);
+}
+
+extern "C"
+{
+    calc_expression *calc_compile(const char *text, unsigned flags, calc_error *error)
+    {
+        CompileOptions options;
+        options.fold = (flags & CALC_NO_FOLD) == 0;
+        options.jit = (flags & CALC_JIT) != 0;
+        try
+        {
+            auto compiled = CompiledExpression::compile(text, options);
+            if (!compiled)
+            {
+                report(compiled.error(), error);
+                return nullptr;
+            }
+            return new calc_expression{std::move(compiled.value())};
+        }
+        catch (const std::bad_alloc &)
+        {
+            report(Diagnostic{ErrorCode::Other, NoColumn, "out of memory"}, error);
+            return nullptr;
+        }
+    }
+
+    void calc_expression_free(calc_expression *expression)
+    {
+        delete expression;
+    }
+
+    uint32_t calc_variable_count(const calc_expression *expression)
+    {
+        return static_cast<uint32_t>(expression->compiled->variableCount());
+    }
+
+    uint32_t calc_variable_id(const calc_expression *expression, const char *name)
+    {
+        return expression->compiled->variable(name);
+    }
+
+    const char *calc_variable_name(const calc_expression *expression, uint32_t id)
+    {
+        // The names are std::strings, so the view is NUL-terminated
+        return id < expression->compiled->variableCount() ? expression->compiled->variableName(id).data() : nullptr;
+    }
+
+    calc_context *calc_context_new(const calc_expression *expression)
+    {
+        try
+        {
+            return new calc_context(expression->compiled);
+        }
+        catch (const std::bad_alloc &)
+        {
+            return nullptr;
+        }
+    }
+
+    void calc_context_free(calc_context *context)
+    {
+        delete context;
+    }
+
+    int calc_bind(calc_context *context, uint32_t id, double value)
+    {
+        return context->context.bind(id, value) ? CALC_OK : CALC_UNDEFINED_VARIABLE;
+    }
+
+    void calc_clear(calc_context *context)
+    {
+        context->context.clear();
+    }
+
+    int calc_evaluate(calc_context *context, double *result, calc_error *error)
+    {
+        Expected<double> value = context->context.evaluate();
+        if (!value)
+            return report(value.error(), error);
+        *result = value.value();
+        return CALC_OK;
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef LIBCALC_H
+#define LIBCALC_H
+
+/* --------------------------------------
+ * C ABI of libcalc (engine.h): compile an expression once, then bind
+ * variables by id and evaluate it as often as needed.
+ *
+ *   calc_error error;
+ *   calc_expression *e = calc_compile("x * x + y", 0, &error);
+ *   calc_context *c = calc_context_new(e);
+ *   calc_bind(c, calc_variable_id(e, "x"), 3);
+ *   calc_bind(c, calc_variable_id(e, "y"), 1);
+ *   double value;
+ *   if (calc_evaluate(c, &value, &error) != CALC_OK) ...
+ *
+ * An expression is immutable once compiled and may be shared by any
+ * number of threads; a context belongs to one thread at a time. A context
+ * keeps its expression alive, so the two can be freed in any order.
+ * calc_bind and calc_evaluate do not allocate.
+ * -------------------------------------- */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct calc_expression calc_expression;
+    typedef struct calc_context calc_context;
+
+    /* Error codes (the values of ErrorCode in diagnostic.h) */
+    enum
+    {
+        CALC_OK = 0,
+        CALC_EXPECTED_PAREN = 1,
+        CALC_EXPECTED_CALL_PAREN = 2,
+        CALC_EXPECTED_ARGUMENT_PAREN = 3,
+        CALC_MISSING_OPERAND = 4,
+        CALC_INVALID_NUMBER = 5,
+        CALC_UNDEFINED_VARIABLE = 6,
+        CALC_DIVISION_BY_ZERO = 7,
+        CALC_OTHER_ERROR = 8
+    };
+
+    /* calc_compile flags */
+    enum
+    {
+        CALC_NO_FOLD = 1, /* no constant folding */
+        CALC_JIT = 2      /* native code where supported */
+    };
+
+#define CALC_NO_VARIABLE UINT32_MAX
+#define CALC_NO_COLUMN UINT32_MAX
+
+    typedef struct calc_error
+    {
+        int code;
+        uint32_t column;  /* offset in the expression text, or CALC_NO_COLUMN */
+        char message[96]; /* as the calculator prints it after "Error: " */
+    } calc_error;
+
+    /* NULL on error, with 'error' (if not NULL) filled in */
+    calc_expression *calc_compile(const char *text, unsigned flags, calc_error *error);
+    void calc_expression_free(calc_expression *expression);
+
+    /* Variables are numbered 0 .. count - 1 in order of appearance */
+    uint32_t calc_variable_count(const calc_expression *expression);
+    uint32_t calc_variable_id(const calc_expression *expression, const char *name);
+    /* NUL-terminated, valid while the expression lives */
+    const char *calc_variable_name(const calc_expression *expression, uint32_t id);
+
+    /* NULL if out of memory */
+    calc_context *calc_context_new(const calc_expression *expression);
+    void calc_context_free(calc_context *context);
+
+    /* CALC_OK, or CALC_UNDEFINED_VARIABLE for an id the expression lacks */
+    int calc_bind(calc_context *context, uint32_t id, double value);
+    void calc_clear(calc_context *context);
+
+    /* CALC_OK with the value in 'result', or an error code with 'error'
+     * (if not NULL) filled in; an unbound variable is an error */
+    int calc_evaluate(calc_context *context, double *result, calc_error *error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCALC_H */
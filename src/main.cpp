@@ -1,139 +1,321 @@
 #include <iostream>
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <string_view>
 #include <vector>
+#include <cstdlib>
+#include <memory>
 
-#include "lexer.h"
-#include "parser.h"
-#include "evaluator.h"
-#include "symbolTable.h"
+#include "session.h"
+#include "batch.h"
+#include "compiledFile.h"
+#include "expressionCache.h"
+#include "threadPool.h"
 #include "utils.h"
+#include "mappedFile.h"
+#include "server.h"
+#include "watch.h"
+#include "stream.h"
+#include "stats.h"
+#include "memoryTracker.h"
+#include "mathKernels.h"
 
-int main(int argc, char *argv[])
+static bool nextSession(SessionSplitter &sessions, std::string_view &session)
 {
-    if (argc != 2)
-    {
-        std::cout << "Usage: calc inputFileName\n";
-        return 1;
-    }
-
-    std::string filename = argv[1];
-    std::string fileContent = readFile(filename);
-
-    if (fileContent.empty())
-    {
-        std::cout << "Error: Could not read file or file is empty.\n";
-        return 1;
-    }
+    stats::Timer timer(stats::SplitSessions);
+    return sessions.next(session);
+}
 
-    // Split file content into sessions
-    auto sessions = splitSessions(fileContent);
+// Serial path: evaluate and print one session at a time
+static void runSerial(MappedFile &file, const SessionOptions &options)
+{
+    SessionSplitter sessions(file.view());
+    std::string_view session;
+    OutputBuffer out(stdout);
 
     int sessionIndex = 1;
-    const std::string separator(50, '-');
-
-    for (const auto &session : sessions)
+    while (nextSession(sessions, session))
     {
+        // Pages before this session are no longer needed
+        file.discardBefore(session.data());
 
         // Skip empty sessions
         if (trim(session).empty())
             continue;
 
-        SymbolTable Symbols; // reset per session
-        std::stringstream ss(session);
-        std::string line;
-
-        std::vector<std::string> rawLines;
-        std::vector<std::string> answers;
-
-        // First, process variable definitions
-        while (std::getline(ss, line))
-        {
+        runSession(session, sessionIndex, out, options);
+        sessionIndex++;
+    }
+}
 
-            std::string cleaned = trim(line);
+// Parallel path: sessions are evaluated in windows on the thread pool and
+// each window is printed in input order once all of it has finished.
+static void runParallel(MappedFile &file, size_t jobs, const SessionOptions &options)
+{
+    ThreadPool pool(jobs);
 
-            // skip if empty OR too short to be a real expression
-            if (cleaned == "" || cleaned == "\r" || cleaned == "\n")
-                continue;
+    // Enough work per window to keep every worker busy, small enough that
+    // buffered output stays bounded
+    const size_t windowSize = jobs * 256;
+    const size_t chunkSize = 16;
 
-            rawLines.push_back(cleaned);
+    SessionSplitter sessions(file.view());
+    std::string_view session;
+    std::vector<std::string_view> window;
+    std::vector<OutputBuffer> outputs(windowSize);
+    OutputBuffer out(stdout);
 
-            // If the line contains "=", it's a variable definition.
-            if (cleaned.find('=') != std::string::npos)
-            {
-                size_t pos = cleaned.find('=');
-                std::string varName = trim(cleaned.substr(0, pos));
-                std::string varValue = trim(cleaned.substr(pos + 1));
-
-                // Lex and parse the value expression
-                try
-                {
-                    Lexer lex(varValue);
-                    Parser parser(lex);
-                    auto ast = parser.parseExpression();
-
-                    Evaluator eval(Symbols);
-                    double result = eval.evaluate(ast);
-
-                    Symbols.set(varName, result);
-                }
-                catch (const std::exception &ex)
-                {
-                    answers.push_back(std::string("Error: ") + ex.what());
-                }
-            }
-            else
+    int sessionIndex = 1;
+    bool more = true;
+    while (more)
+    {
+        window.clear();
+        {
+            memtrack::Tag tag(memtrack::Input);
+            while (window.size() < windowSize && (more = nextSession(sessions, session)))
             {
-                // then, evaluate the expression
-                std::string expr = cleaned;
-
-                if (trim(expr).empty())
-                    continue;
-
-                try
-                {
-                    Lexer lex(expr);
-                    Parser parser(lex);
-                    auto ast = parser.parseExpression();
-
-                    Evaluator eval(Symbols);
-                    double result = eval.evaluate(ast);
-
-                    answers.push_back("Answer: " + formatDouble(result));
-                }
-                catch (const std::exception &ex)
-                {
-                    answers.push_back(std::string("Error: ") + ex.what());
-                }
+                if (!trim(session).empty())
+                    window.push_back(session);
             }
         }
+        if (window.empty())
+            break;
+
+        for (size_t begin = 0; begin < window.size(); begin += chunkSize)
+        {
+            size_t end = std::min(begin + chunkSize, window.size());
+            pool.submit([&, begin, end, firstIndex = sessionIndex]
+                        {
+                            for (size_t i = begin; i < end; i++)
+                            {
+                                outputs[i].clear();
+                                runSession(window[i], firstIndex + static_cast<int>(i), outputs[i], options);
+                            } });
+        }
+        pool.wait();
 
-        // Output results for the input session defined by the user
-        std::cout << "Session " << sessionIndex << ":" << std::endl
-                  << std::endl;
-        for (const auto &l : rawLines)
+        for (size_t i = 0; i < window.size(); i++)
         {
-            std::cout << l << std::endl;
+            out.append(outputs[i].view());
         }
-        std::cout << std::endl;
 
-        if (answers.empty())
+        sessionIndex += static_cast<int>(window.size());
+        file.discardBefore(window.front().data());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t jobs = 1;
+    SessionOptions options;
+    std::string filename;
+    bool validArgs = true;
+    std::string batchExpression;
+    std::string outputFile;
+    size_t cacheSize = 0;
+    bool watch = false;
+    bool compile = false;
+    bool wantStats = false;
+    std::string socketPath;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--jobs" && i + 1 < argc)
+        {
+            jobs = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--backend" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (name == "tree")
+                options.backend = Backend::Tree;
+            else if (name == "vm")
+                options.backend = Backend::Bytecode;
+            else
+                validArgs = false;
+        }
+        else if (arg == "--batch" && i + 1 < argc)
+        {
+            batchExpression = argv[++i];
+        }
+        else if (arg == "--serve" && i + 1 < argc)
+        {
+            socketPath = argv[++i];
+        }
+        else if (arg == "--compile")
+        {
+            compile = true;
+        }
+        else if (arg == "-o" && i + 1 < argc)
+        {
+            outputFile = argv[++i];
+        }
+        else if (arg == "--cache" && i + 1 < argc)
+        {
+            cacheSize = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--jit")
+        {
+            options.jit = true;
+        }
+        else if (arg == "--watch")
+        {
+            watch = true;
+        }
+        else if (arg == "--stats")
+        {
+            wantStats = true;
+        }
+        else if (arg == "--mem-report")
+        {
+            if (!memtrack::available)
+                std::cerr << "calc: --mem-report needs a build with make MEM_TRACKING=1\n";
+            memtrack::enable();
+        }
+        else if (arg == "--no-fold")
+        {
+            options.foldConstants = false;
+        }
+        else if (arg == "--cse")
+        {
+            options.shareSubexpressions = true;
+        }
+        else if (arg == "--exact")
+        {
+            options.exactIntegers = true;
+        }
+        else if (arg == "--math" && i + 1 < argc)
         {
-            std::cout << "Answer: (no expression)" << std::endl;
+            math::Accuracy accuracy;
+            if (math::parseAccuracy(argv[++i], accuracy))
+                math::setAccuracy(accuracy);
+            else
+                validArgs = false;
+        }
+        else if (filename.empty())
+        {
+            filename = arg;
         }
         else
         {
-            for (const auto &ans : answers)
+            validArgs = false;
+        }
+    }
+
+    // Only a run over a file reaches stats::report; the other modes never
+    // finish or are not probed
+    if (wantStats && (watch || compile || !socketPath.empty() || !batchExpression.empty() || filename == "-"))
+        validArgs = false;
+
+    // Streamed lines are compiled in one stage and run in the next, so there
+    // is no AST left for the tree walker
+    if (filename == "-" && options.backend == Backend::Tree)
+        validArgs = false;
+
+    // Native code is made for cached expressions only
+    if (options.jit && cacheSize == 0)
+        validArgs = false;
+
+    if (!validArgs || (filename.empty() == socketPath.empty()) || jobs == 0 || (compile && outputFile.empty()))
+    {
+        std::cout << "Usage: calc [--jobs N] [--backend vm|tree] [--no-fold] [--cse] [--exact] [--math libm|ulp1|fast] [--cache N [--jit]] [--stats] [--mem-report] [--watch] inputFileName|-\n"
+                  << "       calc --batch expression columnFile [--math libm|ulp1|fast] [-o outputFile]\n"
+                  << "       calc --compile inputFileName -o compiledFile\n"
+                  << "       calc --serve socketPath [--jobs N] [--backend vm|tree] [--no-fold] [--cse] [--exact] [--math libm|ulp1|fast] [--cache N [--jit]]\n";
+        return 1;
+    }
+
+    if (wantStats)
+        stats::enable();
+
+    // One expression over a file of variable columns
+    if (!batchExpression.empty())
+    {
+        return runBatch(batchExpression, filename, outputFile);
+    }
+
+    std::unique_ptr<ExpressionCache> cache;
+    if (cacheSize > 0)
+    {
+        cache = std::make_unique<ExpressionCache>(cacheSize);
+        options.cache = cache.get();
+    }
+
+    // Answer requests over a socket until interrupted
+    if (!socketPath.empty())
+    {
+        return runServer(socketPath, jobs, options);
+    }
+
+    // Sessions from stdin, each printed as soon as it is evaluated
+    if (filename == "-")
+    {
+        return runStream(jobs, options);
+    }
+
+    // Re-evaluate on every change until interrupted
+    if (watch)
+    {
+        return runWatch(filename, options);
+    }
+
+    MappedFile file(filename);
+
+    if (!file.isOpen())
+    {
+        std::cout << "Error: Could not read file or file is empty.\n";
+        return 1;
+    }
+
+    // Lex, parse and compile once; run the result later with `calc out`
+    if (compile)
+    {
+        try
+        {
+            compileSessions(file.view(), outputFile, options.foldConstants);
+        }
+        catch (const std::exception &ex)
+        {
+            std::cout << "Error: " << ex.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    // A file written by --compile is evaluated without lexing or parsing
+    if (CompiledFile::isCompiled(file.view()))
+    {
+        try
+        {
+            CompiledFile compiled(file.view());
+            OutputBuffer out(stdout);
+            for (size_t i = 0; i < compiled.sessionCount(); i++)
             {
-                std::cout << ans << std::endl;
+                compiled.runSession(i, out);
             }
         }
+        catch (const std::exception &ex)
+        {
+            std::cout << "Error: " << ex.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
 
-        std::cout << separator << std::endl
-                  << std::endl;
-        sessionIndex++;
+    if (jobs > 1)
+        runParallel(file, jobs, options);
+    else
+        runSerial(file, options);
+
+    if (cache)
+    {
+        std::cerr << "cache: hits=" << cache->hits()
+                  << " misses=" << cache->misses()
+                  << " evictions=" << cache->evictions() << "\n";
     }
 
+    stats::report(stderr);
+    memtrack::report(stderr);
+
     return 0;
 }
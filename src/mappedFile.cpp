@@ -0,0 +1,123 @@
+#include "mappedFile.h"
+#include "stats.h"
+#include "memoryTracker.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &filename)
+{
+    memtrack::Tag tag(memtrack::Input);
+    stats::Timer timer(stats::ReadFile);
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return;
+    }
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = static_cast<const char *>(view);
+    length = static_cast<size_t>(size.QuadPart);
+}
+
+void MappedFile::discardBefore(const char *)
+{
+    // Views of a read-only file mapping are paged out by the OS on demand
+}
+
+MappedFile::~MappedFile()
+{
+    if (data)
+        UnmapViewOfFile(data);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &filename)
+{
+    memtrack::Tag tag(memtrack::Input);
+    stats::Timer timer(stats::ReadFile);
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    void *addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (addr == MAP_FAILED)
+        return;
+
+    // Sessions are scanned front to back exactly once
+    madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    data = static_cast<const char *>(addr);
+    length = static_cast<size_t>(st.st_size);
+}
+
+void MappedFile::discardBefore(const char *pos)
+{
+    // Only bother once a sizeable chunk has been consumed
+    const size_t chunk = 64 * 1024 * 1024;
+    if (!data || pos < data || pos > data + length)
+        return;
+
+    size_t consumed = static_cast<size_t>(pos - data);
+    if (consumed < discarded + chunk)
+        return;
+
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t end = consumed / page * page;
+    madvise(const_cast<char *>(data) + discarded, end - discarded, MADV_DONTNEED);
+    discarded = end;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data)
+        munmap(const_cast<char *>(data), length);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+// The contents are exposed as a std::string_view, so sessions and lines can
+// be sliced out of it without copying. Pages are loaded on demand by the OS.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // True if the file was opened and mapped (false for empty files)
+    bool isOpen() const { return data != nullptr; }
+
+    std::string_view view() const { return std::string_view(data, length); }
+
+    // Hint that everything before 'pos' has been consumed, so its pages can be
+    // dropped from memory. Keeps resident size flat while streaming large files.
+    void discardBefore(const char *pos);
+
+private:
+    const char *data = nullptr;
+    size_t length = 0;
+    size_t discarded = 0; // bytes already released from the front
+
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#endif
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,304 @@
+#include "mathKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CALC_HAVE_AVX2_MATH 1
+#endif
+
+namespace math
+{
+    Accuracy selected = Libm;
+
+    namespace
+    {
+        // Where the tiers give up, and the whole libm tier
+        double libmSin(double x) { return std::sin(x); }
+        double libmCos(double x) { return std::cos(x); }
+        double libmExp(double x) { return std::exp(x); }
+        double libmLog(double x) { return std::log(x); }
+        double libmPow(double x, double y) { return ::power(x, y); }
+
+        // 1.5 * 2^52: adding it to an integral double below 2^51 leaves the
+        // integer in the low bits of the mantissa, two's complement
+        const double IntegerMagic = 6755399441055744.0;
+
+        void sinBlock(double *a, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+                a[i] = std::sin(a[i]);
+        }
+        void cosBlock(double *a, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+                a[i] = std::cos(a[i]);
+        }
+        void expBlock(double *a, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+                a[i] = std::exp(a[i]);
+        }
+        void logBlock(double *a, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+                a[i] = std::log(a[i]);
+        }
+        void powBlock(double *a, const double *b, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+                a[i] = ::power(a[i], b[i]);
+        }
+
+        const Functions libmFunctions = {libmSin, libmCos, libmExp, libmLog, libmPow};
+        const Kernels libmKernels = {sinBlock, cosBlock, expBlock, logBlock, powBlock};
+    }
+
+    // --------------------------------------
+    // Scalar lanes: one double, std::fma
+    // --------------------------------------
+    namespace scalar
+    {
+        using Real = double;
+        using Mask = bool;
+        const size_t Lanes = 1;
+
+        inline Real splat(double c) { return c; }
+        inline Real load(const double *p) { return *p; }
+        inline void store(double *p, Real x) { *p = x; }
+        inline Real fmadd(Real a, Real b, Real c) { return std::fma(a, b, c); }
+        inline Real roundNearest(Real x) { return std::nearbyint(x); }
+
+        inline Real select(Mask m, Real a, Real b) { return m ? a : b; }
+        inline Mask greater(Real a, Real b) { return a > b; }
+        inline Mask isZero(Real x) { return x == 0; }
+        inline Mask outside(Real x, double low, double high) { return !(x >= low && x <= high); }
+        inline Mask either(Mask a, Mask b) { return a || b; }
+        inline bool any(Mask m) { return m; }
+
+        inline uint64_t bitsOf(Real x)
+        {
+            uint64_t bits;
+            std::memcpy(&bits, &x, sizeof(bits));
+            return bits;
+        }
+
+        inline Real fromBits(uint64_t bits)
+        {
+            Real x;
+            std::memcpy(&x, &bits, sizeof(x));
+            return x;
+        }
+
+        // Bit 'bit' of the integral value n
+        inline Mask bitSet(Real n, int bit) { return (bitsOf(n + IntegerMagic) >> bit) & 1; }
+
+        // x = 2^k * m, m in [1, 2); x positive and normal
+        inline Real exponent(Real x, Real &m)
+        {
+            uint64_t bits = bitsOf(x);
+            m = fromBits((bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull);
+            return static_cast<double>(static_cast<int>(bits >> 52)) - 1023;
+        }
+
+        // x * 2^k for integral k, result and x normal
+        inline Real scale(Real x, Real k) { return fromBits(bitsOf(x) + (bitsOf(k + IntegerMagic) << 52)); }
+
+        inline Real patch(Real result, Real x, Mask m, double (*f)(double)) { return m ? f(x) : result; }
+        inline Real patch(Real result, Real x, Real y, Mask m, double (*f)(double, double))
+        {
+            return m ? f(x, y) : result;
+        }
+
+#include "mathKernels.inc"
+    }
+
+#ifdef CALC_HAVE_AVX2_MATH
+
+    // --------------------------------------
+    // AVX2 lanes: four doubles
+    // --------------------------------------
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+    namespace avx2
+    {
+        using Real = __m256d;
+        using Mask = __m256d;
+        const size_t Lanes = 4;
+
+        inline Real splat(double c) { return _mm256_set1_pd(c); }
+        inline Real load(const double *p) { return _mm256_loadu_pd(p); }
+        inline void store(double *p, Real x) { _mm256_storeu_pd(p, x); }
+        inline Real fmadd(Real a, Real b, Real c) { return _mm256_fmadd_pd(a, b, c); }
+        inline Real roundNearest(Real x) { return _mm256_round_pd(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+        inline Real select(Mask m, Real a, Real b) { return _mm256_blendv_pd(b, a, m); }
+        inline Mask greater(Real a, Real b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+        inline Mask isZero(Real x) { return _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_EQ_OQ); }
+        inline Mask outside(Real x, double low, double high)
+        {
+            return _mm256_or_pd(_mm256_cmp_pd(x, splat(low), _CMP_NGE_UQ), _mm256_cmp_pd(x, splat(high), _CMP_NLE_UQ));
+        }
+        inline Mask either(Mask a, Mask b) { return _mm256_or_pd(a, b); }
+        inline bool any(Mask m) { return _mm256_movemask_pd(m) != 0; }
+
+        // blendv only looks at the sign bit, so move the bit there
+        inline Mask bitSet(Real n, int bit)
+        {
+            __m256i bits = _mm256_castpd_si256(_mm256_add_pd(n, splat(IntegerMagic)));
+            return _mm256_castsi256_pd(_mm256_sll_epi64(bits, _mm_cvtsi32_si128(63 - bit)));
+        }
+
+        inline Real exponent(Real x, Real &m)
+        {
+            __m256i bits = _mm256_castpd_si256(x);
+            m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFll)),
+                                                    _mm256_set1_epi64x(0x3FF0000000000000ll)));
+            // The biased exponent is below 2^52: read it back as a double
+            __m256i biased = _mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(0x4330000000000000ll));
+            return _mm256_castsi256_pd(biased) - splat(4503599627370496.0 + 1023);
+        }
+
+        inline Real scale(Real x, Real k)
+        {
+            __m256i shift = _mm256_slli_epi64(_mm256_castpd_si256(_mm256_add_pd(k, splat(IntegerMagic))), 52);
+            return _mm256_castsi256_pd(_mm256_add_epi64(_mm256_castpd_si256(x), shift));
+        }
+
+        inline Real patch(Real result, Real x, Mask m, double (*f)(double))
+        {
+            alignas(32) double r[4], in[4];
+            _mm256_store_pd(r, result);
+            _mm256_store_pd(in, x);
+            int lanes = _mm256_movemask_pd(m);
+            for (int i = 0; i < 4; i++)
+                if (lanes & (1 << i))
+                    r[i] = f(in[i]);
+            return _mm256_load_pd(r);
+        }
+
+        inline Real patch(Real result, Real x, Real y, Mask m, double (*f)(double, double))
+        {
+            alignas(32) double r[4], in[4], exponents[4];
+            _mm256_store_pd(r, result);
+            _mm256_store_pd(in, x);
+            _mm256_store_pd(exponents, y);
+            int lanes = _mm256_movemask_pd(m);
+            for (int i = 0; i < 4; i++)
+                if (lanes & (1 << i))
+                    r[i] = f(in[i], exponents[i]);
+            return _mm256_load_pd(r);
+        }
+
+#include "mathKernels.inc"
+    }
+
+#pragma GCC pop_options
+
+#endif
+
+    namespace
+    {
+        bool vectorLanes()
+        {
+#ifdef CALC_HAVE_AVX2_MATH
+            static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            return supported;
+#else
+            return false;
+#endif
+        }
+
+        // One value through the block kernel of the tier
+        template <Accuracy A>
+        double sinOf(double x)
+        {
+            kernels(A).sin(&x, 1);
+            return x;
+        }
+        template <Accuracy A>
+        double cosOf(double x)
+        {
+            kernels(A).cos(&x, 1);
+            return x;
+        }
+        template <Accuracy A>
+        double expOf(double x)
+        {
+            kernels(A).exp(&x, 1);
+            return x;
+        }
+        template <Accuracy A>
+        double logOf(double x)
+        {
+            kernels(A).log(&x, 1);
+            return x;
+        }
+        template <Accuracy A>
+        double powOf(double x, double y)
+        {
+            kernels(A).pow(&x, &y, 1);
+            return x;
+        }
+
+        const Functions ulp1Functions = {sinOf<Ulp1>, cosOf<Ulp1>, expOf<Ulp1>, logOf<Ulp1>, powOf<Ulp1>};
+        const Functions fastFunctions = {sinOf<Fast>, cosOf<Fast>, expOf<Fast>, logOf<Fast>, powOf<Fast>};
+
+        const char *accuracyNames[AccuracyCount] = {"libm", "ulp1", "fast"};
+    }
+
+    bool parseAccuracy(std::string_view name, Accuracy &out)
+    {
+        for (int a = 0; a < AccuracyCount; a++)
+        {
+            if (name == accuracyNames[a])
+            {
+                out = static_cast<Accuracy>(a);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char *accuracyName(Accuracy accuracy)
+    {
+        return accuracyNames[accuracy];
+    }
+
+    const Functions &functions(Accuracy accuracy)
+    {
+        switch (accuracy)
+        {
+        case Ulp1:
+            return ulp1Functions;
+        case Fast:
+            return fastFunctions;
+        default:
+            return libmFunctions;
+        }
+    }
+
+    const Kernels &kernels(Accuracy accuracy)
+    {
+#ifdef CALC_HAVE_AVX2_MATH
+        if (accuracy != Libm && vectorLanes())
+            return accuracy == Ulp1 ? avx2::ulp1Kernels : avx2::fastKernels;
+#endif
+        switch (accuracy)
+        {
+        case Ulp1:
+            return scalar::ulp1Kernels;
+        case Fast:
+            return scalar::fastKernels;
+        default:
+            return libmKernels;
+        }
+    }
+
+    void setAccuracy(Accuracy accuracy)
+    {
+        selected = accuracy;
+    }
+}
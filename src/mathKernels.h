@@ -0,0 +1,85 @@
+#ifndef MATH_KERNELS_H
+#define MATH_KERNELS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "integer.h"
+
+// sin, cos, exp, log and pow in three accuracy tiers, chosen once per run
+// with --math:
+//   libm  the C library (pow through power()); the default, bit-identical
+//         to what the evaluators always computed
+//   ulp1  at most 1 ulp: Cody-Waite reduction carried in double-double,
+//         fdlibm kernels, pow through a double-double log
+//   fast  at most 4 ulp: single-double reduction and a division-free exp
+// ulp1 and fast run four values per instruction with AVX2 and FMA when the
+// CPU has both, scalar code otherwise; both give the same bits. Arguments
+// the reductions do not cover (|x| > 2^20 for sin/cos, subnormal or
+// non-positive logs and pow bases, results near overflow) are passed to the
+// C library one at a time.
+
+namespace math
+{
+    enum Accuracy : uint8_t
+    {
+        Libm,
+        Ulp1,
+        Fast,
+        AccuracyCount
+    };
+
+    // "libm", "ulp1" or "fast"
+    bool parseAccuracy(std::string_view name, Accuracy &out);
+    const char *accuracyName(Accuracy accuracy);
+
+    // One value at a time
+    struct Functions
+    {
+        double (*sin)(double);
+        double (*cos)(double);
+        double (*exp)(double);
+        double (*log)(double);
+        double (*pow)(double, double);
+    };
+
+    // A block at a time: a[i] = f(a[i]); pow: a[i] = a[i] ^ b[i]
+    struct Kernels
+    {
+        void (*sin)(double *a, size_t n);
+        void (*cos)(double *a, size_t n);
+        void (*exp)(double *a, size_t n);
+        void (*log)(double *a, size_t n);
+        void (*pow)(double *a, const double *b, size_t n);
+    };
+
+    const Functions &functions(Accuracy accuracy);
+    const Kernels &kernels(Accuracy accuracy);
+
+    // The tier every evaluator uses; set before evaluating anything
+    extern Accuracy selected;
+    void setAccuracy(Accuracy accuracy);
+
+    inline const Functions &functions() { return functions(selected); }
+    inline const Kernels &kernels() { return kernels(selected); }
+
+    // The selected tier, with the C library inlined for the default
+    inline double sin(double x)
+    {
+        return selected == Libm ? std::sin(x) : functions().sin(x);
+    }
+
+    inline double cos(double x)
+    {
+        return selected == Libm ? std::cos(x) : functions().cos(x);
+    }
+
+    inline double pow(double x, double y)
+    {
+        return selected == Libm ? power(x, y) : functions().pow(x, y);
+    }
+}
+
+#endif // MATH_KERNELS_H
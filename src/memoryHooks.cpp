@@ -0,0 +1,153 @@
+// Replacements of the global allocation functions for bin/calc, built with
+// make MEM_TRACKING=1. Every block carries a header recording its size and
+// the subsystem that allocated it, so frees are charged back correctly even
+// when another thread (or another subsystem) releases the memory.
+
+#ifdef CALC_MEM_TRACKING
+
+#include "memoryTracker.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    struct Header
+    {
+        size_t size;
+        memtrack::Subsystem subsystem;
+    };
+
+    // Keeps the user pointer aligned for any fundamental type
+    constexpr size_t HeaderSize = 16;
+    static_assert(sizeof(Header) <= HeaderSize, "allocation header too large");
+
+    void *attach(void *block, size_t offset, size_t size)
+    {
+        char *user = static_cast<char *>(block) + offset;
+        Header *header = reinterpret_cast<Header *>(user - sizeof(Header));
+        header->size = size;
+        header->subsystem = memtrack::current;
+        memtrack::recordAllocation(header->subsystem, size);
+        return user;
+    }
+
+    // Returns the start of the block
+    void *detach(void *user, size_t offset)
+    {
+        Header *header = reinterpret_cast<Header *>(static_cast<char *>(user) - sizeof(Header));
+        memtrack::recordFree(header->subsystem, header->size);
+        return static_cast<char *>(user) - offset;
+    }
+
+    void *allocate(size_t size)
+    {
+        void *block = std::malloc(size + HeaderSize);
+        return block ? attach(block, HeaderSize, size) : nullptr;
+    }
+
+    // The header sits in a whole extra alignment unit in front of the block
+    void *allocateAligned(size_t size, size_t alignment)
+    {
+        if (alignment < HeaderSize)
+            alignment = HeaderSize;
+        void *block = nullptr;
+        if (posix_memalign(&block, alignment, size + alignment) != 0)
+            return nullptr;
+        return attach(block, alignment, size);
+    }
+
+    void *allocateOrThrow(size_t size)
+    {
+        for (;;)
+        {
+            if (void *p = allocate(size))
+                return p;
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+
+    void *allocateAlignedOrThrow(size_t size, size_t alignment)
+    {
+        for (;;)
+        {
+            if (void *p = allocateAligned(size, alignment))
+                return p;
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+
+    void release(void *p)
+    {
+        if (p)
+            std::free(detach(p, HeaderSize));
+    }
+
+    void releaseAligned(void *p, size_t alignment)
+    {
+        if (p)
+            std::free(detach(p, alignment < HeaderSize ? HeaderSize : alignment));
+    }
+}
+
+void *operator new(size_t size) { return allocateOrThrow(size); }
+void *operator new[](size_t size) { return allocateOrThrow(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    return allocateAlignedOrThrow(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+    return allocateAlignedOrThrow(size, static_cast<size_t>(alignment));
+}
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocateAligned(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocateAligned(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *p) noexcept { release(p); }
+void operator delete[](void *p) noexcept { release(p); }
+void operator delete(void *p, size_t) noexcept { release(p); }
+void operator delete[](void *p, size_t) noexcept { release(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { release(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { release(p); }
+
+void operator delete(void *p, std::align_val_t alignment) noexcept
+{
+    releaseAligned(p, static_cast<size_t>(alignment));
+}
+void operator delete[](void *p, std::align_val_t alignment) noexcept
+{
+    releaseAligned(p, static_cast<size_t>(alignment));
+}
+void operator delete(void *p, size_t, std::align_val_t alignment) noexcept
+{
+    releaseAligned(p, static_cast<size_t>(alignment));
+}
+void operator delete[](void *p, size_t, std::align_val_t alignment) noexcept
+{
+    releaseAligned(p, static_cast<size_t>(alignment));
+}
+void operator delete(void *p, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    releaseAligned(p, static_cast<size_t>(alignment));
+}
+void operator delete[](void *p, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    releaseAligned(p, static_cast<size_t>(alignment));
+}
+
+#endif
@@ -0,0 +1,150 @@
+#include "memoryTracker.h"
+
+#ifdef CALC_MEM_TRACKING
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+namespace memtrack
+{
+    namespace
+    {
+        struct Counters
+        {
+            std::atomic<uint64_t> allocations{0};
+            std::atomic<uint64_t> bytes{0};
+            std::atomic<int64_t> live{0};
+            std::atomic<int64_t> peak{0};
+        };
+
+        Counters subsystems[SubsystemCount];
+        Counters total;
+
+        const char *subsystemNames[SubsystemCount] = {
+            "other", "input", "lexer", "parser", "compiler", "evaluator", "symbols", "cache", "output"};
+
+        struct SessionUsage
+        {
+            int index = 0; // 0 outside a session
+            uint64_t allocations = 0;
+            uint64_t bytes = 0;
+            int64_t live = 0;
+            int64_t peak = 0;
+        };
+
+        thread_local SessionUsage session;
+
+        // The sessions with the highest peaks so far, highest first. Fixed
+        // size, so recording one never allocates.
+        constexpr size_t TopSessions = 10;
+        std::mutex topMutex;
+        SessionUsage top[TopSessions];
+        size_t topCount = 0;
+
+        bool enabled = false;
+
+        void raisePeak(std::atomic<int64_t> &peak, int64_t value)
+        {
+            int64_t seen = peak.load(std::memory_order_relaxed);
+            while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        void add(Counters &c, size_t bytes)
+        {
+            c.allocations.fetch_add(1, std::memory_order_relaxed);
+            c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+            int64_t live = c.live.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) +
+                           static_cast<int64_t>(bytes);
+            raisePeak(c.peak, live);
+        }
+
+        void print(std::FILE *out, const char *name, uint64_t allocations, uint64_t bytes, int64_t peak)
+        {
+            std::fprintf(out, "\"%s\": {\"allocations\": %llu, \"bytes\": %llu, \"peak_live_bytes\": %lld}", name,
+                         static_cast<unsigned long long>(allocations), static_cast<unsigned long long>(bytes),
+                         static_cast<long long>(peak));
+        }
+    }
+
+    void recordAllocation(Subsystem s, size_t bytes)
+    {
+        add(subsystems[s], bytes);
+        add(total, bytes);
+        if (session.index != 0)
+        {
+            session.allocations++;
+            session.bytes += bytes;
+            session.live += static_cast<int64_t>(bytes);
+            session.peak = std::max(session.peak, session.live);
+        }
+    }
+
+    void recordFree(Subsystem s, size_t bytes)
+    {
+        subsystems[s].live.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+        total.live.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+        if (session.index != 0)
+            session.live -= static_cast<int64_t>(bytes);
+    }
+
+    SessionScope::SessionScope(int index)
+    {
+        session = SessionUsage();
+        session.index = index;
+    }
+
+    SessionScope::~SessionScope()
+    {
+        SessionUsage finished = session;
+        session.index = 0;
+
+        std::lock_guard<std::mutex> lock(topMutex);
+        size_t i = topCount < TopSessions ? topCount++ : TopSessions;
+        if (i == TopSessions)
+        {
+            if (finished.peak <= top[TopSessions - 1].peak)
+                return;
+            i = TopSessions - 1;
+        }
+        for (; i > 0 && top[i - 1].peak < finished.peak; i--)
+            top[i] = top[i - 1];
+        top[i] = finished;
+    }
+
+    void enable()
+    {
+        enabled = true;
+    }
+
+    void report(std::FILE *out)
+    {
+        if (!enabled)
+            return;
+
+        std::fprintf(out, "{");
+        print(out, "total", total.allocations.load(), total.bytes.load(), total.peak.load());
+        std::fprintf(out, ", \"subsystems\": {");
+        for (int s = 0; s < SubsystemCount; s++)
+        {
+            if (s)
+                std::fprintf(out, ", ");
+            print(out, subsystemNames[s], subsystems[s].allocations.load(), subsystems[s].bytes.load(),
+                  subsystems[s].peak.load());
+        }
+        std::fprintf(out, "}, \"top_sessions\": [");
+
+        std::lock_guard<std::mutex> lock(topMutex);
+        for (size_t i = 0; i < topCount; i++)
+        {
+            std::fprintf(out, "%s{\"session\": %d, \"allocations\": %llu, \"bytes\": %llu, \"peak_live_bytes\": %lld}",
+                         i ? ", " : "", top[i].index, static_cast<unsigned long long>(top[i].allocations),
+                         static_cast<unsigned long long>(top[i].bytes), static_cast<long long>(top[i].peak));
+        }
+        std::fprintf(out, "]}\n");
+    }
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Allocation accounting by subsystem and by session, reported with
+// --mem-report. Only built with -DCALC_MEM_TRACKING (make MEM_TRACKING=1),
+// which also links replacements of the global operator new/delete into
+// bin/calc (memoryHooks.cpp); otherwise every probe compiles to nothing.
+
+namespace memtrack
+{
+    // Who asked for the memory: the innermost Tag on the allocating thread
+    enum Subsystem : uint8_t
+    {
+        Other,
+        Input,     // reading the file, splitting sessions
+        Lexer,
+        Parser,    // AST arena
+        Compiler,  // folding, bytecode, native code
+        Evaluator, // VM stack, tree walker, error messages
+        Symbols,   // symbol tables and interned names
+        Cache,     // expression cache
+        Output,    // output buffers
+        SubsystemCount
+    };
+
+#ifdef CALC_MEM_TRACKING
+
+    constexpr bool available = true;
+
+    inline thread_local Subsystem current = Other;
+
+    // Attributes allocations made during its lifetime to a subsystem
+    class Tag
+    {
+    public:
+        explicit Tag(Subsystem s) : previous(current) { current = s; }
+        ~Tag() { current = previous; }
+
+        Tag(const Tag &) = delete;
+        Tag &operator=(const Tag &) = delete;
+
+    private:
+        Subsystem previous;
+    };
+
+    // Accounts allocations made on this thread during its lifetime to
+    // session 'index' (per-session peaks are relative to the start)
+    class SessionScope
+    {
+    public:
+        explicit SessionScope(int index);
+        ~SessionScope();
+
+        SessionScope(const SessionScope &) = delete;
+        SessionScope &operator=(const SessionScope &) = delete;
+    };
+
+    // Called by the operator new/delete replacements
+    void recordAllocation(Subsystem s, size_t bytes);
+    void recordFree(Subsystem s, size_t bytes);
+
+    // Turn on report(); the counters themselves always run
+    void enable();
+
+    // Write the JSON report if enabled (after all worker threads finished)
+    void report(std::FILE *out);
+
+#else
+
+    constexpr bool available = false;
+
+    class Tag
+    {
+    public:
+        explicit Tag(Subsystem) {}
+    };
+
+    class SessionScope
+    {
+    public:
+        explicit SessionScope(int) {}
+    };
+
+    inline void enable() {}
+    inline void report(std::FILE *) {}
+
+#endif
+}
+
+#endif // MEMORY_TRACKER_H
@@ -0,0 +1,50 @@
+#ifndef NODE_SLOTS_H
+#define NODE_SLOTS_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+
+constexpr uint32_t NoSlot = UINT32_MAX;
+
+// --------------------------------------
+// Slot number of each shared node met during one walk over an arena
+// (a temporary, or a position in a vector of values), found in O(1) by
+// NodeIndex. Entries are stamped with the walk that set them, so reset()
+// forgets the previous walk without touching the table; like SimpleStack,
+// a table reused for every expression stops allocating once it has grown
+// to the largest arena.
+// --------------------------------------
+class NodeSlots
+{
+public:
+    // Start a walk over an arena of 'nodeCount' nodes
+    void reset(size_t nodeCount)
+    {
+        if (entries.size() < nodeCount)
+            entries.resize(nodeCount);
+        if (++walk == 0)
+        {
+            for (auto &e : entries)
+                e.first = 0;
+            walk = 1;
+        }
+    }
+
+    // Slot of 'index' in this walk, or NoSlot
+    uint32_t find(NodeIndex index) const
+    {
+        const auto &e = entries[index];
+        return e.first == walk ? e.second : NoSlot;
+    }
+
+    void set(NodeIndex index, uint32_t slot) { entries[index] = {walk, slot}; }
+
+private:
+    std::vector<std::pair<uint32_t, uint32_t>> entries; // walk, slot
+    uint32_t walk = 0;
+};
+
+#endif // NODE_SLOTS_H
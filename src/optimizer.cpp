@@ -0,0 +1,269 @@
+#include "optimizer.h"
+#include "lexer.h"
+#include "mathKernels.h"
+#include "memoryTracker.h"
+#include "nodeSlots.h"
+#include "simpleStack.h"
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// True if the node is a literal that converted successfully
+static bool isConstant(const AstArena &arena, NodeIndex node)
+{
+    return node != NullNode &&
+           arena[node].kind == NodeKind::Number &&
+           !arena[node].invalid;
+}
+
+// Turn a node into a literal holding 'value'
+static void makeConstant(ASTNode &node, double value)
+{
+    node.kind = NodeKind::Number;
+    node.invalid = false;
+    node.left = NullNode;
+    node.right = NullNode;
+    node.value = value;
+}
+
+namespace
+{
+    // A node still to be visited: first its operands are pushed
+    // (expanded = false), then the node itself is handled
+    struct Frame
+    {
+        NodeIndex index;
+        bool expanded;
+    };
+
+    // Whether a subtree is integer-only, and its value if so
+    struct Exact
+    {
+        bool exact;
+        Integer value;
+    };
+
+    // Reused by every pass on this thread
+    thread_local SimpleStack<Frame> work;
+    thread_local SimpleStack<Exact> exactValues;
+    thread_local NodeSlots visited;              // shared nodes folded
+    thread_local std::vector<Exact> sharedValues; // shared nodes valued, by slot
+    thread_local NodeSlots sharedSlots;           // slot in 'sharedValues' of each
+
+    // Push the operands of 'node' so the left one is handled first
+    void expand(const ASTNode &node, NodeIndex index)
+    {
+        work.push(Frame{index, true});
+        if (node.kind == NodeKind::BinaryOp)
+            work.push(Frame{node.right, false});
+        work.push(Frame{node.left, false});
+    }
+}
+
+// Fold one operation whose operands have been folded already
+static void foldNode(AstArena &arena, ASTNode &node)
+{
+    if (node.kind == NodeKind::BinaryOp)
+    {
+        if (!isConstant(arena, node.left) || !isConstant(arena, node.right))
+            return;
+
+        double l = arena[node.left].value;
+        double r = arena[node.right].value;
+        switch (node.op)
+        {
+        case '+':
+            makeConstant(node, l + r);
+            break;
+        case '-':
+            makeConstant(node, l - r);
+            break;
+        case '*':
+            makeConstant(node, l * r);
+            break;
+        case '/':
+            if (r != 0) // keep the runtime "Division by zero"
+                makeConstant(node, l / r);
+            break;
+        case '^':
+            makeConstant(node, math::pow(l, r));
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+
+    if (!isConstant(arena, node.left))
+        return;
+
+    double arg = arena[node.left].value;
+    makeConstant(node, node.func == FunctionId::Sin ? math::sin(arg) : math::cos(arg));
+}
+
+// Bottom-up on an explicit stack; a shared node is folded at its first
+// parent only
+void foldConstants(AstArena &arena, NodeIndex root)
+{
+    work.clear();
+    visited.reset(arena.size());
+    work.push(Frame{root, false});
+    while (!work.empty())
+    {
+        Frame frame = work.pop();
+        if (frame.index == NullNode)
+            continue;
+
+        ASTNode &node = arena[frame.index];
+        if (node.kind != NodeKind::BinaryOp && node.kind != NodeKind::Function)
+            continue;
+
+        if (frame.expanded)
+        {
+            foldNode(arena, node);
+            continue;
+        }
+        if (node.shared)
+        {
+            if (visited.find(frame.index) != NoSlot)
+                continue;
+            visited.set(frame.index, 0);
+        }
+        expand(node, frame.index);
+    }
+}
+
+// Combine the operands of an operation into the node's Exact. Exact
+// operands of other nodes are queued in 'promoted' rather than rewritten
+// right away: in a hash-consed tree another parent may still need the
+// operand's exact value.
+static Exact combineExact(const ASTNode &node, Exact *operands,
+                          std::vector<std::pair<NodeIndex, double>> &promoted)
+{
+    if (node.kind == NodeKind::Function)
+    {
+        if (operands[0].exact)
+            promoted.emplace_back(node.left, operands[0].value.toDouble());
+        return Exact{false, Integer()};
+    }
+
+    Exact &l = operands[0];
+    Exact &r = operands[1];
+    if (l.exact && r.exact)
+    {
+        switch (node.op)
+        {
+        case '+':
+            return Exact{true, l.value + r.value};
+        case '-':
+            return Exact{true, l.value - r.value};
+        case '*':
+            return Exact{true, l.value * r.value};
+        case '^':
+        {
+            Integer value;
+            if (Integer::power(l.value, r.value, value))
+                return Exact{true, std::move(value)};
+            break;
+        }
+        default: // '/' is left to double arithmetic
+            break;
+        }
+    }
+
+    // Operands are promoted to double here
+    if (l.exact)
+        promoted.emplace_back(node.left, l.value.toDouble());
+    if (r.exact)
+        promoted.emplace_back(node.right, r.value.toDouble());
+    return Exact{false, Integer()};
+}
+
+// True if the tree is integer-only, with its value in 'value'. Post-order
+// on explicit stacks; a shared node is valued once.
+static bool exactValue(const AstArena &arena, NodeIndex root, std::string_view text, Integer &value,
+                       std::vector<std::pair<NodeIndex, double>> &promoted)
+{
+    work.clear();
+    exactValues.clear();
+    sharedValues.clear();
+    sharedSlots.reset(arena.size());
+    work.push(Frame{root, false});
+    while (!work.empty())
+    {
+        Frame frame = work.pop();
+        if (frame.index == NullNode)
+        {
+            exactValues.push(Exact{false, Integer()});
+            continue;
+        }
+
+        const ASTNode &node = arena[frame.index];
+        if (frame.expanded)
+        {
+            size_t count = node.kind == NodeKind::BinaryOp ? 2 : 1;
+            Exact operands[2];
+            for (size_t i = count; i-- > 0;)
+                operands[i] = exactValues.pop();
+            Exact result = combineExact(node, operands, promoted);
+            if (node.shared)
+            {
+                sharedSlots.set(frame.index, static_cast<uint32_t>(sharedValues.size()));
+                sharedValues.push_back(result);
+            }
+            exactValues.push(std::move(result));
+            continue;
+        }
+
+        switch (node.kind)
+        {
+        case NodeKind::Number:
+        {
+            // A missing operand has no literal to read
+            Exact literal{false, Integer()};
+            literal.exact = node.error != ErrorCode::MissingOperand &&
+                            Integer::fromLiteral(literalAt(text, node.offset), literal.value);
+            exactValues.push(std::move(literal));
+            break;
+        }
+        case NodeKind::Variable:
+            exactValues.push(Exact{false, Integer()});
+            break;
+        case NodeKind::BinaryOp:
+        case NodeKind::Function:
+        {
+            if (node.shared)
+            {
+                uint32_t slot = sharedSlots.find(frame.index);
+                if (slot != NoSlot)
+                {
+                    exactValues.push(sharedValues[slot]);
+                    break;
+                }
+            }
+            expand(node, frame.index);
+            break;
+        }
+        }
+    }
+
+    Exact result = exactValues.pop();
+    value = std::move(result.value);
+    return result.exact;
+}
+
+bool foldIntegers(AstArena &arena, NodeIndex root, std::string_view text, Integer &result)
+{
+    memtrack::Tag tag(memtrack::Compiler);
+    static thread_local std::vector<std::pair<NodeIndex, double>> promoted;
+    promoted.clear();
+
+    if (exactValue(arena, root, text, result, promoted))
+    {
+        makeConstant(arena[root], result.toDouble());
+        return true;
+    }
+    for (const auto &p : promoted)
+        makeConstant(arena[p.first], p.second);
+    return false;
+}
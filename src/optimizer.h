@@ -0,0 +1,24 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <string_view>
+
+#include "ast.h"
+#include "integer.h"
+
+// Constant folding: rewrite every BinaryOp / Function node whose operands
+// are all valid literals into a Number node, in place.
+// Divisions by a constant zero are left in place so the error is still
+// raised at the same point during evaluation.
+void foldConstants(AstArena &arena, NodeIndex node);
+
+// Typed evaluation (--exact): subtrees made only of integer literals and
+// + - * ^ are computed exactly with Integer. If that covers the whole tree
+// the value is left in 'result' and true is returned. Otherwise every such
+// subtree becomes a literal holding its value rounded to double, which also
+// gives hex literals over 64 bits and binary literals over 31 bits their
+// true value. 'text' is what the tree was parsed from (literals are read
+// again from it). Runs before foldConstants.
+bool foldIntegers(AstArena &arena, NodeIndex root, std::string_view text, Integer &result);
+
+#endif // OPTIMIZER_H
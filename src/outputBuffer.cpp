@@ -0,0 +1,40 @@
+#include "outputBuffer.h"
+#include "stats.h"
+#include "utils.h"
+
+#include <charconv>
+
+OutputBuffer::OutputBuffer(std::FILE *out, size_t flushThreshold)
+    : sink(out), threshold(flushThreshold)
+{
+    memtrack::Tag tag(memtrack::Output);
+    data.reserve(sink ? threshold + FormatDoubleMax : 256);
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+}
+
+void OutputBuffer::appendNumber(double value)
+{
+    char text[FormatDoubleMax];
+    append(std::string_view(text, formatDouble(value, text)));
+}
+
+void OutputBuffer::appendInt(long long value)
+{
+    char text[24];
+    append(std::string_view(text, std::to_chars(text, text + sizeof(text), value).ptr - text));
+}
+
+void OutputBuffer::flush()
+{
+    memtrack::Tag tag(memtrack::Output);
+    if (!sink || data.empty())
+        return;
+    stats::Timer timer(stats::Output);
+    std::fwrite(data.data(), 1, data.size(), sink);
+    std::fflush(sink);
+    data.clear();
+}
@@ -0,0 +1,57 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "memoryTracker.h"
+
+// Growable text buffer for program output.
+// With a sink (e.g. stdout) the text is written in large chunks once the
+// buffer passes the flush threshold, and on flush()/destruction.
+// Without a sink it just collects text, e.g. one session's block that a
+// worker thread renders for the main thread to print later.
+class OutputBuffer
+{
+public:
+    explicit OutputBuffer(std::FILE *sink = nullptr, size_t flushThreshold = 1 << 20);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+    OutputBuffer(OutputBuffer &&) = default;
+
+    void append(std::string_view s)
+    {
+        memtrack::Tag tag(memtrack::Output);
+        data.append(s.data(), s.size());
+        if (sink && data.size() >= threshold)
+            flush();
+    }
+    void append(char c)
+    {
+        memtrack::Tag tag(memtrack::Output);
+        data.push_back(c);
+        if (sink && data.size() >= threshold)
+            flush();
+    }
+
+    // Number formatted like formatDouble()
+    void appendNumber(double value);
+    void appendInt(long long value);
+
+    std::string_view view() const { return data; }
+    bool empty() const { return data.empty(); }
+    void clear() { data.clear(); }
+
+    // Write everything buffered so far to the sink
+    void flush();
+
+private:
+    std::string data;
+    std::FILE *sink;
+    size_t threshold;
+};
+
+#endif // OUTPUT_BUFFER_H
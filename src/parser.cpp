@@ -1,151 +1,278 @@
 #include "parser.h"
-#include <stdexcept>
-#include <iostream>
+#include "stats.h"
+#include "memoryTracker.h"
+#include "simpleStack.h"
+#include <cstring>
+#include <vector>
 
-// Constructor: Load first token
-Parser::Parser(Lexer &lexer)
-    : lex(lexer)
+namespace
 {
-    currentToken = lex.getNextToken();
-}
+    // Open-addressing table of the nodes built so far for the expression
+    // being hash-consed; reused by every parse on this thread
+    thread_local std::vector<NodeIndex> shareTable;
+    thread_local size_t shareCount = 0;
 
-// Move to next token
-void Parser::advance()
-{
-    currentToken = lex.getNextToken();
+    size_t hashNode(const ASTNode &n)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &n.value, sizeof(bits));
+        uint64_t h = static_cast<uint64_t>(n.kind) | static_cast<uint64_t>(static_cast<uint8_t>(n.op)) << 8 |
+                     static_cast<uint64_t>(n.func) << 16;
+        h = (h ^ n.left) * 0x9E3779B97F4A7C15ULL;
+        h = (h ^ n.right) * 0x9E3779B97F4A7C15ULL;
+        h = (h ^ n.symbol) * 0x9E3779B97F4A7C15ULL;
+        h = (h ^ bits) * 0x9E3779B97F4A7C15ULL;
+        // The table is indexed by the low bits, which the multiplications
+        // above take from the low bits of their inputs only; small integer
+        // literals differ in the high bits of 'value'. Mix those down.
+        h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDULL;
+        return static_cast<size_t>(h ^ (h >> 33));
+    }
+
+    void insertShared(NodeIndex node, size_t hash)
+    {
+        size_t mask = shareTable.size() - 1;
+        size_t i = hash & mask;
+        while (shareTable[i] != NullNode)
+            i = (i + 1) & mask;
+        shareTable[i] = node;
+        shareCount++;
+    }
+
+    // An operator waiting for its right operand (level 1 to 3), or an open
+    // "(" / function call waiting for its ")" (level 0)
+    struct Pending
+    {
+        char op;
+        uint8_t level;
+        bool call;
+        FunctionId func;
+        uint32_t offset; // of the operator or function name
+    };
+
+    const int PowerLevel = 3;
+
+    // Operands and operators of the expression being parsed; reused by
+    // every parse on this thread
+    thread_local SimpleStack<NodeIndex> operands;
+    thread_local SimpleStack<Pending> pending;
+
+    // Binding strength of a binary operator token, 0 for any other token
+    int precedence(const Token &t)
+    {
+        if (t.type != TokenType::Operator)
+            return 0;
+        switch (t.op)
+        {
+        case Operator::Plus:
+        case Operator::Minus:
+            return 1;
+        case Operator::Star:
+        case Operator::Slash:
+            return 2;
+        case Operator::Caret:
+            return PowerLevel;
+        default:
+            return 0;
+        }
+    }
 }
 
-// Expect a token type and advance
-void Parser::expect(TokenType t)
+// Constructor: Load first token
+Parser::Parser(Lexer &lexer, AstArena &arena, SymbolTable &table, bool shareNodes)
+    : lex(lexer), nodes(arena), symbols(table), sharing(shareNodes)
 {
-    if (currentToken.type != t)
+    if (sharing)
     {
-        throw std::runtime_error("Parser error: unexpected token '");
+        // Back to the small size, so a line after a very long one does not
+        // pay for clearing the long one's table
+        shareTable.assign(64, NullNode);
+        shareCount = 0;
     }
     advance();
 }
 
-// Entry point for parsing an expression
-std::unique_ptr<ASTNode> Parser::parseExpression()
+// Literals must also be spelled the same: "1" and "1.0" differ under
+// exact integer evaluation
+bool Parser::sameNode(const ASTNode &a, const ASTNode &b) const
 {
-    return parseExpressionLevel();
+    if (a.kind != b.kind || a.op != b.op || a.func != b.func || a.left != b.left || a.right != b.right ||
+        a.symbol != b.symbol || std::memcmp(&a.value, &b.value, sizeof(double)) != 0)
+        return false;
+    return a.kind != NodeKind::Number ||
+           literalAt(lex.input(), a.offset) == literalAt(lex.input(), b.offset);
 }
 
-// expression := term ((+|-) term)*
-std::unique_ptr<ASTNode> Parser::parseExpressionLevel()
+// Hash-consing step for the node just added: keep it, or drop it in favour
+// of an equal node built earlier
+NodeIndex Parser::share(NodeIndex node)
 {
-    auto node = parseTerm();
+    if (!sharing || nodes[node].invalid)
+        return node;
 
-    while (currentToken.type == TokenType::Operator &&
-           (currentToken.lexeme == "+" || currentToken.lexeme == "-"))
+    // Keep the table at most half full
+    if ((shareCount + 1) * 2 > shareTable.size())
     {
-        char op = currentToken.lexeme[0];
-        advance();
-        auto right = parseTerm();
-        node = std::make_unique<BinaryOpNode>(op, std::move(node), std::move(right));
+        std::vector<NodeIndex> old(shareTable.size() * 2, NullNode);
+        old.swap(shareTable);
+        shareCount = 0;
+        for (NodeIndex n : old)
+        {
+            if (n != NullNode)
+                insertShared(n, hashNode(nodes[n]));
+        }
     }
 
+    size_t hash = hashNode(nodes[node]);
+    size_t mask = shareTable.size() - 1;
+    for (size_t i = hash & mask; shareTable[i] != NullNode; i = (i + 1) & mask)
+    {
+        NodeIndex other = shareTable[i];
+        if (sameNode(nodes[other], nodes[node]))
+        {
+            nodes.removeLast();
+            nodes[other].shared = true;
+            return other;
+        }
+    }
+    insertShared(node, hash);
     return node;
 }
 
-// term := factor ((*|/) factor)*
-std::unique_ptr<ASTNode> Parser::parseTerm()
+// Move to next token
+void Parser::advance()
 {
+    stats::SampledTimer timer(stats::Lex);
+    currentToken = lex.getNextToken();
+    stats::count(stats::Tokens);
+}
 
-    auto node = parseFactor();
+// Entry point for parsing an expression
+Expected<NodeIndex> Parser::parseExpression()
+{
+    memtrack::Tag tag(memtrack::Parser);
+    operands.clear();
+    pending.clear();
 
-    while (currentToken.type == TokenType::Operator &&
-           (currentToken.lexeme == "*" || currentToken.lexeme == "/"))
+    Diagnostic error;
+    for (;;)
     {
-        char op = currentToken.lexeme[0];
-        advance();
-        auto right = parseFactor();
-        node = std::make_unique<BinaryOpNode>(op, std::move(node), std::move(right));
-    }
+        // Operand: any number of '(' and 'sin(' in front of a primary
+        while (openGroup(error))
+        {
+        }
+        if (error.code != ErrorCode::None)
+            return error;
+        operands.push(parsePrimary());
 
-    return node;
+        // Operator, or the end of the innermost group
+        for (;;)
+        {
+            int level = precedence(currentToken);
+            if (level != 0)
+            {
+                reduce(level);
+                pending.push(Pending{operatorChar(currentToken.op), static_cast<uint8_t>(level), false,
+                                     FunctionId::Sin, currentToken.offset});
+                advance();
+                break;
+            }
+
+            // The expression ends at the first token that cannot continue it
+            reduce(0);
+            if (pending.empty())
+                return operands.pop();
+            Pending group = pending.pop();
+            if (!closeGroup(group.call, group.func, group.offset, error))
+                return error;
+        }
+    }
 }
 
-// factor := primary (^ factor)?
-// Handle right-associative exponentiation
-std::unique_ptr<ASTNode> Parser::parseFactor()
+// "(" or function "(": true if one was opened, false with 'error' set if
+// a function name is not followed by "("
+bool Parser::openGroup(Diagnostic &error)
 {
+    // Function call (sin, cos)
+    if (currentToken.type == TokenType::Function)
+    {
+        FunctionId func = (lex.lexeme(currentToken) == "sin") ? FunctionId::Sin : FunctionId::Cos;
+        uint32_t offset = currentToken.offset;
+        advance(); // get '('
 
-    auto node = parsePrimary();
+        if (currentToken.type != TokenType::LParen)
+        {
+            error = Diagnostic{ErrorCode::ExpectedCallParen, currentToken.offset, std::string_view()};
+            return false;
+        }
 
-    if (currentToken.type == TokenType::Operator && currentToken.lexeme == "^")
-    {
-        // char op = currentToken.lexeme[0];
-        advance();
-        auto right = parseFactor(); // right-associative
-        node = std::make_unique<BinaryOpNode>('^', std::move(node), std::move(right));
+        advance(); // skip '('
+        pending.push(Pending{0, 0, true, func, offset});
+        return true;
     }
 
-    return node;
+    // Parentheses
+    if (currentToken.type == TokenType::LParen)
+    {
+        advance(); // skip '('
+        pending.push(Pending{0, 0, false, FunctionId::Sin, 0});
+        return true;
+    }
+    return false;
 }
 
-// primary := number | identifier | "(" expression ")" | function "(" expression ")"
-std::unique_ptr<ASTNode> Parser::parsePrimary()
+// The group's expression is on top of the operand stack
+bool Parser::closeGroup(bool call, FunctionId func, uint32_t offset, Diagnostic &error)
 {
+    if (currentToken.type != TokenType::RParen)
+    {
+        error = Diagnostic{call ? ErrorCode::ExpectedArgumentParen : ErrorCode::ExpectedParen, currentToken.offset,
+                           std::string_view()};
+        return false;
+    }
+    advance(); // skip ')'
+    if (call)
+        operands.top() = share(nodes.addFunction(func, operands.top(), offset));
+    return true;
+}
 
-    // Skip empty tokens (should not happen in well-formed input)
-    while (currentToken.type == TokenType::EndOfFile ||
-           (currentToken.type == TokenType::Unknown && currentToken.lexeme == ""))
+// Build the pending operators that bind at least as tightly as an operator
+// of 'level' (more tightly for right-associative '^'); 0 builds every
+// operator of the innermost group
+void Parser::reduce(int level)
+{
+    while (!pending.empty() && pending.top().level != 0 &&
+           (pending.top().level > level || (pending.top().level == level && level != PowerLevel)))
     {
-        return nullptr;
+        Pending op = pending.pop();
+        NodeIndex right = operands.pop();
+        operands.top() = share(nodes.addBinary(op.op, operands.top(), right, op.offset));
     }
+}
 
+// primary := number | identifier. Anything else is a missing operand: it
+// becomes a node that reports the error (at the token found instead) if
+// evaluation gets that far, and the token is left for the caller.
+NodeIndex Parser::parsePrimary()
+{
     // Number
     if (currentToken.type == TokenType::Number)
     {
-        std::string text = currentToken.lexeme;
+        // Convert the literal now so evaluation never touches the text again
+        Expected<double> value = convertNumber(lex.lexeme(currentToken));
+        NodeIndex number = value ? share(nodes.addNumber(value.value(), currentToken.offset))
+                                 : nodes.addInvalidNumber(value.error().detail, currentToken.offset);
         advance();
-        return std::make_unique<NumberNode>(text);
+        return number;
     }
 
     // variable
     if (currentToken.type == TokenType::Identifier)
     {
-        std::string name = currentToken.lexeme;
+        NodeIndex variable = share(nodes.addVariable(symbols.intern(lex.lexeme(currentToken)), currentToken.offset));
         advance();
-        return std::make_unique<VariableNode>(name);
+        return variable;
     }
 
-    // Function call (sin, cos)
-    if (currentToken.type == TokenType::Function)
-    {
-        std::string func = currentToken.lexeme;
-        advance(); // get '('
-
-        if (currentToken.type != TokenType::LParen)
-        {
-            throw std::runtime_error("Parser error: expected '(' after function name");
-        }
-
-        advance(); // skip '('
-        auto arg = parseExpression();
-
-        if (currentToken.type != TokenType::RParen)
-        {
-            throw std::runtime_error("Parser error: expected ')' after function argument");
-        }
-        advance(); // skip ')'
-        return std::make_unique<UnaryFunctionNode>(func, std::move(arg));
-    }
-
-    // Parentheses
-    if (currentToken.type == TokenType::LParen)
-    {
-        advance(); // skip '('
-        auto expr = parseExpression();
-
-        if (currentToken.type != TokenType::RParen)
-        {
-            throw std::runtime_error("Parser error: expected ')'");
-        }
-        advance(); // skip ')'
-        return expr;
-    }
-    // If we reach here, it's an error. Don't crush; just return nullptr.
-    return nullptr;
+    return nodes.addMissing(currentToken.offset);
 }
@@ -1,81 +1,55 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <memory>
 #include <string>
 #include "lexer.h"
-
-// AST Node Base Class
-class ASTNode
-{
-public:
-    virtual ~ASTNode() = default;
-};
-
-// Number Node
-class NumberNode : public ASTNode
-{
-public:
-    std::string raw; // raw number lexeme (e.g., "10", "0x1F", "1100b" )
-    explicit NumberNode(const std::string &r) : raw(r) {}
-};
-
-// Variable Node
-class VariableNode : public ASTNode
-{
-public:
-    std::string name;
-    explicit VariableNode(const std::string &n) : name(n) {}
-};
-
-// Binary Operator Node
-class BinaryOpNode : public ASTNode
-{
-public:
-    char op;
-    std::unique_ptr<ASTNode> left;
-    std::unique_ptr<ASTNode> right;
-
-    BinaryOpNode(char oper,
-                 std::unique_ptr<ASTNode> l,
-                 std::unique_ptr<ASTNode> r)
-        : op(oper), left(std::move(l)), right(std::move(r)) {}
-};
-
-// Unary Function Node (sin, cos only)
-class UnaryFunctionNode : public ASTNode
-{
-public:
-    std::string func; // "sin" or "cos" only
-    std::unique_ptr<ASTNode> argument;
-
-    UnaryFunctionNode(const std::string &f,
-                      std::unique_ptr<ASTNode> arg)
-        : func(f), argument(std::move(arg)) {}
-};
-
-// Parser Class (recursive descent)
+#include "ast.h"
+#include "symbolTable.h"
+
+// Parser Class (operator precedence, on explicit stacks)
+//   expression := term ((+|-) term)*
+//   term       := factor ((*|/) factor)*
+//   factor     := primary (^ factor)?        right-associative
+//   primary    := number | identifier | "(" expression ")" | function "(" expression ")"
+// Parentheses and operators are kept on SimpleStacks rather than on the
+// call stack, so nesting depth is limited only by memory.
+// Nodes are allocated in the arena passed in; parseExpression returns the
+// root's index, or the Diagnostic of a parser error (at the offending
+// token). A missing operand is not a parser error: it is parsed as a node
+// that fails when evaluated, so errors keep their evaluation order.
+// Variable names are interned into the symbol table as they are parsed.
+//
+// With 'shareNodes' the parser hash-conses: a node equal to one already
+// built for this expression (same kind, operator, value or variable, and
+// same children) is not added again, the existing node is returned and
+// marked shared. Repeated subexpressions then form a DAG that the compiler
+// and evaluator compute once.
 class Parser
 {
 public:
-    explicit Parser(Lexer &lexer);
+    Parser(Lexer &lexer, AstArena &arena, SymbolTable &table, bool shareNodes = false);
+
+    Expected<NodeIndex> parseExpression();
 
-    std::unique_ptr<ASTNode> parseExpression();
+    // The token that ended the expression (EndOfFile if it ran to the end
+    // of the input)
+    const Token &stopToken() const { return currentToken; }
 
 private:
     Lexer &lex;
+    AstArena &nodes;
+    SymbolTable &symbols;
     Token currentToken;
+    bool sharing;
 
     void advance();
-    void expect(TokenType t);
-
-    // Recursive descent methods
-    std::unique_ptr<ASTNode> parseExpressionLevel();
-    std::unique_ptr<ASTNode> parseTerm();
-    std::unique_ptr<ASTNode> parseFactor();
-    std::unique_ptr<ASTNode> parsePrimary();
+    NodeIndex share(NodeIndex node);
+    bool sameNode(const ASTNode &a, const ASTNode &b) const;
 
-    std::unique_ptr<ASTNode> parseFunction();
+    bool openGroup(Diagnostic &error);
+    bool closeGroup(bool call, FunctionId func, uint32_t offset, Diagnostic &error);
+    void reduce(int level);
+    NodeIndex parsePrimary();
 };
 
 #endif // PARSER_H
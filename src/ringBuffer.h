@@ -0,0 +1,113 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// --------------------------------------
+// Bounded lock-free queue for exactly one producer and one consumer
+// thread. Each side keeps a cached copy of the other side's index so that
+// the shared cache line is only read when the ring looks full (or empty).
+// --------------------------------------
+template <typename T>
+class SpscRing
+{
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer: move 'value' in; false (value untouched) if the ring is full
+    bool tryPush(T &value)
+    {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - cachedHead == slots.size())
+        {
+            cachedHead = headIndex.load(std::memory_order_acquire);
+            if (tail - cachedHead == slots.size())
+                return false;
+        }
+        slots[tail & mask] = std::move(value);
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: move the oldest value out; false if the ring is empty
+    bool tryPop(T &value)
+    {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == cachedTail)
+        {
+            cachedTail = tailIndex.load(std::memory_order_acquire);
+            if (head == cachedTail)
+                return false;
+        }
+        value = std::move(slots[head & mask]);
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer: no more values will be pushed
+    void close() { finished.store(true, std::memory_order_release); }
+
+    // Consumer: true once the producer has closed the ring. Values pushed
+    // before close() can still be popped.
+    bool closed() const { return finished.load(std::memory_order_acquire); }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+
+    // Consumer side
+    alignas(64) std::atomic<size_t> headIndex{0};
+    size_t cachedTail = 0;
+
+    // Producer side
+    alignas(64) std::atomic<size_t> tailIndex{0};
+    size_t cachedHead = 0;
+
+    alignas(64) std::atomic<bool> finished{false};
+};
+
+// Waiting strategy for threads polling a ring: spin briefly, then yield,
+// then sleep, so an idle pipeline (e.g. waiting on a slow input stream)
+// does not keep a core busy
+class Backoff
+{
+public:
+    void pause()
+    {
+        if (rounds < 64)
+        {
+            rounds++;
+        }
+        else if (rounds < 128)
+        {
+            rounds++;
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    void reset() { rounds = 0; }
+
+private:
+    unsigned rounds = 0;
+};
+
+#endif // RING_BUFFER_H
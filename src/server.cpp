@@ -0,0 +1,421 @@
+#include "server.h"
+#include "outputBuffer.h"
+#include "threadPool.h"
+#include "utils.h"
+
+#include <iostream>
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    // Requests read ahead of their responses on one connection before the
+    // server stops reading from it, and the largest request accepted
+    const uint64_t MaxInFlight = 256;
+    const size_t MaxRequestSize = 64 * 1024 * 1024;
+
+    // epoll tags of the fixed descriptors; connections count up from First
+    const uint64_t ListenTag = 0;
+    const uint64_t WakeTag = 1;
+    const uint64_t SignalTag = 2;
+    const uint64_t FirstConnection = 3;
+
+    // SIGINT/SIGTERM are read from a signalfd so that the socket file is
+    // removed on the way out
+    const sigset_t &stopSignals()
+    {
+        static const sigset_t signals = []
+        {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, SIGINT);
+            sigaddset(&set, SIGTERM);
+            return set;
+        }();
+        return signals;
+    }
+
+    // Same output as `calc` for a file holding 'text'
+    void respond(std::string_view text, OutputBuffer &out, const SessionOptions &options)
+    {
+        if (text.empty())
+        {
+            out.append("Error: Could not read file or file is empty.\n");
+            return;
+        }
+
+        SessionSplitter sessions(text);
+        std::string_view session;
+        int sessionIndex = 1;
+        while (sessions.next(session))
+        {
+            if (trim(session).empty())
+                continue;
+            runSession(session, sessionIndex++, out, options);
+        }
+    }
+
+    struct Connection
+    {
+        int fd = -1;
+        std::string input;          // received bytes not yet forming a request
+        uint64_t nextRequest = 0;   // sequence number of the next request read
+        uint64_t nextResponse = 0;  // sequence number of the next response sent
+        std::map<uint64_t, std::string> finished; // done, waiting for earlier ones
+        std::string output;         // responses being written
+        size_t written = 0;
+        uint32_t events = 0;        // currently registered with epoll
+        bool peerClosed = false;    // no more requests will come
+    };
+
+    struct Completion
+    {
+        uint64_t connection;
+        uint64_t sequence;
+        std::string response;
+    };
+
+    class Server
+    {
+    public:
+        Server(size_t workers, const SessionOptions &opts)
+            : pool(workers), options(opts) {}
+
+        ~Server();
+
+        bool listen(const std::string &path);
+        void run();
+
+    private:
+        ThreadPool pool;
+        const SessionOptions &options;
+
+        std::string socketPath; // removed again on exit once bound
+        int epollFd = -1;
+        int listenFd = -1;
+        int wakeFd = -1;
+        int signalFd = -1;
+
+        std::unordered_map<uint64_t, Connection> connections;
+        uint64_t nextId = FirstConnection;
+
+        // Filled by workers, drained by the event loop
+        std::mutex doneMutex;
+        std::vector<Completion> done;
+
+        void accept();
+        void read(uint64_t id, Connection &c);
+        void collect();
+        void flush(Connection &c);
+        void update(uint64_t id, Connection &c);
+        void close(uint64_t id);
+    };
+
+    Server::~Server()
+    {
+        // Workers may still post completions; let them finish first
+        pool.wait();
+        for (auto &entry : connections)
+            ::close(entry.second.fd);
+        for (int fd : {listenFd, wakeFd, signalFd, epollFd})
+            if (fd >= 0)
+                ::close(fd);
+        if (!socketPath.empty())
+            unlink(socketPath.c_str());
+    }
+
+    bool Server::listen(const std::string &path)
+    {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            std::cerr << "Error: socket path is too long\n";
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        // A socket left behind by an earlier run is replaced
+        struct stat existing;
+        if (stat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode))
+            unlink(path.c_str());
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(listenFd, SOMAXCONN) != 0)
+        {
+            std::cerr << "Error: could not listen on " << path << ": " << std::strerror(errno) << "\n";
+            return false;
+        }
+        socketPath = path;
+
+        signalFd = signalfd(-1, &stopSignals(), SFD_NONBLOCK | SFD_CLOEXEC);
+
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (signalFd < 0 || wakeFd < 0 || epollFd < 0)
+        {
+            std::cerr << "Error: " << std::strerror(errno) << "\n";
+            return false;
+        }
+
+        for (auto [fd, tag] : {std::pair<int, uint64_t>{listenFd, ListenTag}, {wakeFd, WakeTag}, {signalFd, SignalTag}})
+        {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = tag;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        }
+        return true;
+    }
+
+    void Server::run()
+    {
+        epoll_event events[64];
+        while (true)
+        {
+            int n = epoll_wait(epollFd, events, 64, -1);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                std::cerr << "Error: epoll_wait: " << std::strerror(errno) << "\n";
+                return;
+            }
+
+            for (int i = 0; i < n; i++)
+            {
+                uint64_t tag = events[i].data.u64;
+                if (tag == ListenTag)
+                {
+                    accept();
+                    continue;
+                }
+                if (tag == WakeTag)
+                {
+                    collect();
+                    continue;
+                }
+                if (tag == SignalTag)
+                    return;
+
+                auto it = connections.find(tag);
+                if (it == connections.end())
+                    continue;
+                Connection &c = it->second;
+
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                {
+                    close(tag);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN)
+                    read(tag, c);
+                if (events[i].events & EPOLLOUT)
+                    flush(c);
+                update(tag, c);
+            }
+        }
+    }
+
+    void Server::accept()
+    {
+        while (true)
+        {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+                return;
+
+            uint64_t id = nextId++;
+            Connection &c = connections[id];
+            c.fd = fd;
+            c.events = EPOLLIN;
+
+            epoll_event event{};
+            event.events = c.events;
+            event.data.u64 = id;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+
+    // Read what is available and hand every complete request to the pool
+    void Server::read(uint64_t id, Connection &c)
+    {
+        char buffer[64 * 1024];
+        while (c.nextRequest - c.nextResponse < MaxInFlight)
+        {
+            ssize_t n = ::read(c.fd, buffer, sizeof(buffer));
+            if (n == 0)
+            {
+                c.peerClosed = true;
+                break;
+            }
+            if (n < 0)
+                break;
+
+            size_t scanned = c.input.size();
+            c.input.append(buffer, static_cast<size_t>(n));
+
+            size_t start = 0;
+            size_t end;
+            while ((end = c.input.find('\0', scanned)) != std::string::npos)
+            {
+                uint64_t sequence = c.nextRequest++;
+                pool.submit([this, id, sequence, text = c.input.substr(start, end - start)]
+                            {
+                                static thread_local OutputBuffer out;
+                                out.clear();
+                                respond(text, out, options);
+
+                                {
+                                    std::lock_guard<std::mutex> lock(doneMutex);
+                                    done.push_back(Completion{id, sequence, std::string(out.view())});
+                                }
+                                uint64_t one = 1;
+                                ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+                                (void)ignored; });
+                start = end + 1;
+                scanned = start;
+            }
+            c.input.erase(0, start);
+
+            if (c.input.size() > MaxRequestSize)
+            {
+                c.peerClosed = true;
+                c.input.clear();
+                break;
+            }
+        }
+    }
+
+    // Move finished responses to their connections
+    void Server::collect()
+    {
+        uint64_t count;
+        ssize_t ignored = ::read(wakeFd, &count, sizeof(count));
+        (void)ignored;
+
+        std::vector<Completion> ready;
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            ready.swap(done);
+        }
+
+        for (Completion &completion : ready)
+        {
+            auto it = connections.find(completion.connection);
+            if (it == connections.end())
+                continue; // client went away
+            it->second.finished.emplace(completion.sequence, std::move(completion.response));
+        }
+        for (Completion &completion : ready)
+        {
+            auto it = connections.find(completion.connection);
+            if (it == connections.end())
+                continue;
+            flush(it->second);
+            update(completion.connection, it->second);
+        }
+    }
+
+    // Queue responses that are next in order and write as much as the
+    // socket takes
+    void Server::flush(Connection &c)
+    {
+        for (auto it = c.finished.begin(); it != c.finished.end() && it->first == c.nextResponse;
+             it = c.finished.erase(it))
+        {
+            c.output.append(it->second);
+            c.output.push_back('\0');
+            c.nextResponse++;
+        }
+
+        while (c.written < c.output.size())
+        {
+            ssize_t n = send(c.fd, c.output.data() + c.written, c.output.size() - c.written, MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            c.written += static_cast<size_t>(n);
+        }
+        if (c.written == c.output.size())
+        {
+            c.output.clear();
+            c.written = 0;
+        }
+    }
+
+    // Register interest in what the connection can make progress on, or
+    // close it once the peer is gone and everything has been answered
+    void Server::update(uint64_t id, Connection &c)
+    {
+        bool idle = c.nextResponse == c.nextRequest && c.output.empty();
+        if (c.peerClosed && idle)
+        {
+            close(id);
+            return;
+        }
+
+        uint32_t wanted = 0;
+        if (!c.peerClosed && c.nextRequest - c.nextResponse < MaxInFlight)
+            wanted |= EPOLLIN;
+        if (!c.output.empty())
+            wanted |= EPOLLOUT;
+        if (wanted == c.events)
+            return;
+
+        c.events = wanted;
+        epoll_event event{};
+        event.events = wanted;
+        event.data.u64 = id;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &event);
+    }
+
+    void Server::close(uint64_t id)
+    {
+        auto it = connections.find(id);
+        if (it == connections.end())
+            return;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        ::close(it->second.fd);
+        connections.erase(it);
+    }
+}
+
+int runServer(const std::string &socketPath, size_t workers, const SessionOptions &options)
+{
+    // Blocked before the workers start so that they inherit the mask
+    pthread_sigmask(SIG_BLOCK, &stopSignals(), nullptr);
+
+    Server server(workers, options);
+    if (!server.listen(socketPath))
+        return 1;
+    server.run();
+    return 0;
+}
+
+#else
+
+int runServer(const std::string &, size_t, const SessionOptions &)
+{
+    std::cerr << "Error: --serve is not supported on this platform\n";
+    return 1;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstddef>
+#include <string>
+
+#include "session.h"
+
+// Entry point for `calc --serve socketPath`: listen on a Unix domain socket
+// and answer requests until SIGINT/SIGTERM.
+//
+// A request is session text in the usual input format (any number of
+// sessions separated by dashed lines) terminated by a NUL byte. The
+// response is exactly what `calc` prints for a file with that text, also
+// terminated by NUL. Clients may pipeline requests; responses on one
+// connection always come back in request order. Requests are evaluated on
+// 'workers' threads. Linux only (epoll).
+int runServer(const std::string &socketPath, size_t workers, const SessionOptions &options);
+
+#endif // SERVER_H
@@ -0,0 +1,446 @@
+#include "session.h"
+
+#include "lexer.h"
+#include "parser.h"
+#include "evaluator.h"
+#include "bytecode.h"
+#include "optimizer.h"
+#include "expressionCache.h"
+#include "symbolTable.h"
+#include "stats.h"
+#include "memoryTracker.h"
+#include "utils.h"
+
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+    // Evaluates the lines of one session with the selected backend
+    class LineEvaluator
+    {
+    public:
+        LineEvaluator(SymbolTable &st, AstArena &arena, const SessionOptions &opts)
+            : symbols(st), nodes(arena), options(opts), vm(st) {}
+
+        Expected<double> evaluate(std::string_view text);
+
+        // Whether the last evaluate() produced an exact integer
+        // (exactIntegers), and its digits
+        bool exact() const { return exactResult; }
+        const std::string &exactText() const { return exactDigits; }
+
+    private:
+        SymbolTable &symbols;
+        AstArena &nodes;
+        const SessionOptions &options;
+        VirtualMachine vm;
+        bool exactResult = false;
+        std::string exactDigits;
+
+        Expected<NodeIndex> parse(std::string_view text);
+        Expected<double> evaluateCached(std::string_view text);
+    };
+
+    Expected<NodeIndex> LineEvaluator::parse(std::string_view text)
+    {
+        NodeIndex ast;
+        {
+            stats::Timer timer(stats::Parse);
+            Lexer lex(text);
+            Parser parser(lex, nodes, symbols, options.shareSubexpressions);
+            Expected<NodeIndex> parsed = parser.parseExpression();
+            if (!parsed)
+                return parsed;
+            ast = parsed.value();
+        }
+
+        if (options.exactIntegers)
+        {
+            stats::Timer timer(stats::Compile);
+            Integer value;
+            if (foldIntegers(nodes, ast, text, value))
+            {
+                exactResult = true;
+                exactDigits = value.toString();
+                return ast;
+            }
+        }
+
+        if (options.foldConstants)
+        {
+            stats::Timer timer(stats::Compile);
+            foldConstants(nodes, ast);
+        }
+        return ast;
+    }
+
+    // Parse and evaluate one expression
+    Expected<double> LineEvaluator::evaluate(std::string_view text)
+    {
+        exactResult = false;
+
+        if (options.backend == Backend::Tree)
+        {
+            Expected<NodeIndex> ast = parse(text);
+            if (!ast)
+                return ast.error();
+            if (exactResult)
+                return nodes[ast.value()].value;
+            stats::Timer timer(stats::Evaluate);
+            Evaluator eval(symbols, nodes);
+            return eval.evaluate(ast.value());
+        }
+
+        if (options.cache)
+            return evaluateCached(text);
+
+        Expected<NodeIndex> ast = parse(text);
+        if (!ast)
+            return ast.error();
+        if (exactResult)
+            return nodes[ast.value()].value;
+        Program program;
+        {
+            stats::Timer timer(stats::Compile);
+            Compiler compiler;
+            program = compiler.compile(nodes, ast.value());
+        }
+        stats::Timer timer(stats::Evaluate);
+        return vm.run(program);
+    }
+
+    // Reuse the compiled form of an expression seen before (in any session);
+    // only its variables are rebound to this session's symbols.
+    Expected<double> LineEvaluator::evaluateCached(std::string_view text)
+    {
+        static thread_local std::string key;
+        static thread_local Program bound;
+
+        ExpressionCache::makeKey(text, key);
+        auto entry = options.cache->find(key);
+        if (!entry)
+        {
+            Expected<NodeIndex> ast = parse(text);
+            if (!ast)
+                return ast.error();
+            stats::Timer timer(stats::Compile);
+            Compiler compiler;
+            auto compiled = std::make_shared<CachedExpression>(compiler.compile(nodes, ast.value()), symbols);
+            if (exactResult)
+                compiled->exact = exactDigits;
+            entry = options.cache->insert(key, std::move(compiled));
+        }
+        else if (!entry->exact.empty())
+        {
+            exactResult = true;
+            exactDigits = entry->exact;
+        }
+
+        stats::Timer timer(stats::Evaluate);
+
+        // Native code reports any error by failing; the interpreter then
+        // runs the line again and raises the exact error
+        const JitProgram *native = options.jit ? entry->native() : nullptr;
+        double slots[16];
+        double result;
+        if (native && entry->names.size() <= 16 && entry->gather(symbols, slots) && native->run(slots, result))
+            return result;
+
+        // Columns are not rebound: take them from the cached program
+        entry->bind(symbols, bound);
+        const std::vector<uint32_t> &columns = entry->program.columns;
+        return vm.run(bound.code.data(), bound.code.size(), bound.constants.data(), bound.failures.data(),
+                      bound.maxStack, bound.temps, columns.empty() ? nullptr : columns.data());
+    }
+
+    // The "Error: ..." line of a failed expression
+    void appendError(OutputBuffer &out, const Diagnostic &error)
+    {
+        stats::countError(error);
+        out.append("Error: ");
+        error.appendMessage(out);
+        out.append('\n');
+    }
+
+    bool sameValue(double a, double b)
+    {
+        return std::memcmp(&a, &b, sizeof(double)) == 0;
+    }
+}
+
+Program compileExpression(std::string_view expr, AstArena &arena, SymbolTable &symbols, bool fold)
+{
+    SessionOptions options;
+    options.foldConstants = fold;
+    std::string exactDigits;
+    return compileExpression(expr, arena, symbols, options, exactDigits);
+}
+
+Program compileExpression(std::string_view expr, AstArena &arena, SymbolTable &symbols,
+                          const SessionOptions &options, std::string &exactDigits)
+{
+    exactDigits.clear();
+    Lexer lex(expr);
+    Parser parser(lex, arena, symbols, options.shareSubexpressions);
+    Expected<NodeIndex> ast = parser.parseExpression();
+    if (!ast)
+    {
+        Program failed;
+        failed.failures.push_back(Failure{ast.error().code, std::string(ast.error().detail)});
+        failed.code.push_back(Instruction{OpCode::Fail, 0});
+        failed.columns.push_back(ast.error().column);
+        failed.maxStack = 1;
+        return failed;
+    }
+
+    // An exact result leaves the root a constant holding its double value
+    Integer value;
+    if (options.exactIntegers && foldIntegers(arena, ast.value(), expr, value))
+        exactDigits = value.toString();
+    else if (options.foldConstants)
+        foldConstants(arena, ast.value());
+    return Compiler().compile(arena, ast.value());
+}
+
+void runSession(std::string_view session, int sessionIndex, OutputBuffer &out,
+                const SessionOptions &options)
+{
+    memtrack::SessionScope scope(sessionIndex);
+    SymbolTable Symbols; // reset per session
+
+    // AST nodes of every line live in this thread's arena until the
+    // session ends; the memory is kept for the next session.
+    static thread_local AstArena arena;
+    arena.clear();
+    LineEvaluator evaluator(Symbols, arena, options);
+    size_t linePos = 0;
+    std::string_view line;
+
+    // Lines are echoed straight into 'out' under the header; answers are
+    // collected separately and appended after them
+    static thread_local OutputBuffer answers;
+    answers.clear();
+
+    out.append("Session ");
+    out.appendInt(sessionIndex);
+    out.append(":\n\n");
+
+    // First, process variable definitions
+    while (nextLine(session, linePos, line))
+    {
+
+        std::string_view cleaned = trim(line);
+
+        // skip if empty OR too short to be a real expression
+        if (cleaned == "" || cleaned == "\r" || cleaned == "\n")
+            continue;
+
+        out.append(cleaned);
+        out.append('\n');
+        stats::count(stats::Lines);
+
+        // If the line contains "=", it's a variable definition.
+        if (cleaned.find('=') != std::string_view::npos)
+        {
+            size_t pos = cleaned.find('=');
+            std::string_view varName = trim(cleaned.substr(0, pos));
+            std::string_view varValue = trim(cleaned.substr(pos + 1));
+
+            // Lex and parse the value expression
+            Expected<double> result = evaluator.evaluate(varValue);
+            if (result)
+                Symbols.set(varName, result.value());
+            else
+                appendError(answers, result.error());
+        }
+        else
+        {
+            // then, evaluate the expression
+            std::string_view expr = cleaned;
+
+            if (trim(expr).empty())
+                continue;
+
+            Expected<double> result = evaluator.evaluate(expr);
+            if (!result)
+            {
+                appendError(answers, result.error());
+                continue;
+            }
+
+            answers.append("Answer: ");
+            if (evaluator.exact())
+                answers.append(evaluator.exactText());
+            else
+                answers.appendNumber(result.value());
+            answers.append('\n');
+        }
+    }
+
+    // Output results for the input session defined by the user
+    out.append('\n');
+
+    if (answers.empty())
+    {
+        out.append("Answer: (no expression)\n");
+    }
+    else
+    {
+        out.append(answers.view());
+    }
+
+    static const std::string separator(50, '-');
+    out.append(separator);
+    out.append("\n\n");
+
+    stats::count(stats::Sessions);
+    stats::count(stats::Nodes, arena.size());
+}
+
+size_t SessionState::update(std::string_view session, const SessionOptions &options)
+{
+    std::vector<Line> previous = std::move(lines);
+    lines.clear();
+    source.assign(session.data(), session.size());
+
+    std::unordered_multimap<std::string_view, size_t> previousByText;
+    for (size_t i = 0; i < previous.size(); i++)
+    {
+        previousByText.emplace(previous[i].text, i);
+    }
+
+    SymbolTable Symbols;
+    AstArena arena;
+    LineEvaluator evaluator(Symbols, arena, options);
+    size_t evaluated = 0;
+    size_t linePos = 0;
+    std::string_view line;
+
+    // The variables a line refers to, as they are right now
+    auto unchanged = [&](const Line &old)
+    {
+        for (const Input &in : old.inputs)
+        {
+            double value = 0;
+            bool set = Symbols.get(in.name, value);
+            if (set != in.set || (set && !sameValue(value, in.value)))
+                return false;
+        }
+        return true;
+    };
+
+    while (nextLine(source, linePos, line))
+    {
+        std::string_view cleaned = trim(line);
+        if (cleaned == "" || cleaned == "\r" || cleaned == "\n")
+            continue;
+
+        size_t pos = cleaned.find('=');
+        std::string_view varName;
+        std::string_view expr = cleaned;
+        if (pos != std::string_view::npos)
+        {
+            varName = trim(cleaned.substr(0, pos));
+            expr = trim(cleaned.substr(pos + 1));
+        }
+
+        // A line with the same text and the same inputs has the same result
+        Line current;
+        bool reused = false;
+        auto range = previousByText.equal_range(cleaned);
+        for (auto it = range.first; it != range.second && !reused; ++it)
+        {
+            if (unchanged(previous[it->second]))
+            {
+                current = previous[it->second];
+                reused = true;
+            }
+        }
+
+        if (!reused)
+        {
+            current.text.assign(cleaned.data(), cleaned.size());
+            current.definition = pos != std::string_view::npos;
+
+            // Every identifier the parser could reach; a superset of the
+            // variables evaluation actually reads
+            Lexer lex(expr);
+            for (Token t = lex.getNextToken();
+                 t.type != TokenType::EndOfFile && t.type != TokenType::EndOfLine && t.type != TokenType::Unknown;
+                 t = lex.getNextToken())
+            {
+                if (t.type != TokenType::Identifier)
+                    continue;
+                Input in;
+                in.name = std::string(lex.lexeme(t));
+                in.set = Symbols.get(in.name, in.value);
+                current.inputs.push_back(std::move(in));
+            }
+
+            Expected<double> result = evaluator.evaluate(expr);
+            if (result)
+            {
+                current.value = result.value();
+                if (evaluator.exact())
+                    current.exact = evaluator.exactText();
+            }
+            else
+            {
+                current.failed = true;
+                current.error = result.error().message();
+            }
+            evaluated++;
+        }
+
+        if (current.definition && !current.failed)
+            Symbols.set(varName, current.value);
+        lines.push_back(std::move(current));
+    }
+    return evaluated;
+}
+
+void SessionState::write(int sessionIndex, OutputBuffer &out) const
+{
+    out.append("Session ");
+    out.appendInt(sessionIndex);
+    out.append(":\n\n");
+
+    for (const Line &l : lines)
+    {
+        out.append(l.text);
+        out.append('\n');
+    }
+    out.append('\n');
+
+    bool answered = false;
+    for (const Line &l : lines)
+    {
+        if (l.failed)
+        {
+            out.append("Error: ");
+            out.append(l.error);
+            out.append('\n');
+        }
+        else if (!l.definition)
+        {
+            out.append("Answer: ");
+            if (!l.exact.empty())
+                out.append(l.exact);
+            else
+                out.appendNumber(l.value);
+            out.append('\n');
+        }
+        else
+        {
+            continue;
+        }
+        answered = true;
+    }
+    if (!answered)
+        out.append("Answer: (no expression)\n");
+
+    static const std::string separator(50, '-');
+    out.append(separator);
+    out.append("\n\n");
+}
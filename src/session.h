@@ -0,0 +1,99 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+#include "bytecode.h"
+#include "outputBuffer.h"
+
+class ExpressionCache;
+
+// Which engine evaluates the parsed expressions
+enum class Backend
+{
+    Bytecode, // compile to a flat instruction tape and run it on the VM
+    Tree      // walk the AST directly (reference implementation)
+};
+
+struct SessionOptions
+{
+    Backend backend = Backend::Bytecode;
+    bool foldConstants = true; // fold constant subtrees before evaluating
+
+    // Hash-cons the AST so repeated subexpressions are evaluated once
+    bool shareSubexpressions = false;
+
+    // Compiled expressions shared across sessions (bytecode backend only);
+    // nullptr disables caching
+    ExpressionCache *cache = nullptr;
+
+    // Run hot cached expressions as native code (needs 'cache')
+    bool jit = false;
+
+    // Typed evaluation: lines made only of integer literals and + - * ^ are
+    // computed exactly and printed with every digit (see foldIntegers)
+    bool exactIntegers = false;
+};
+
+// Evaluate one session (variable definitions followed by expressions) and
+// append the exact block main prints for it to 'out':
+// "Session N:", the echoed lines, the answers and the separator.
+// Sessions share no state, so this is safe to call from several threads.
+void runSession(std::string_view session, int sessionIndex, OutputBuffer &out,
+                const SessionOptions &options = SessionOptions());
+
+// Lex, parse, fold (if asked) and compile one expression. A line that does
+// not parse becomes a single Fail carrying the parser's message, which is
+// what evaluating it would have reported.
+Program compileExpression(std::string_view expr, AstArena &arena, SymbolTable &symbols, bool foldConstants);
+
+// The same with the folding, sharing (shareSubexpressions) and exact
+// integers of 'options', as runSession compiles a line for the VM.
+// 'exactDigits' gets the digits of an exact integer result, or is cleared.
+Program compileExpression(std::string_view expr, AstArena &arena, SymbolTable &symbols,
+                          const SessionOptions &options, std::string &exactDigits);
+
+// A session kept between re-runs of --watch. Every line remembers its result
+// and the values of the variables it refers to; update() evaluates a line
+// again only if its text is new or one of those values has changed, so
+// editing "pi = 3.14" recomputes just the lines that use pi.
+class SessionState
+{
+public:
+    // Bring the state up to date with the new text of the session and
+    // return the number of lines that had to be evaluated
+    size_t update(std::string_view session, const SessionOptions &options = SessionOptions());
+
+    // Append the same block runSession() would produce
+    void write(int sessionIndex, OutputBuffer &out) const;
+
+    const std::string &text() const { return source; }
+
+private:
+    // A variable as it was when the line was evaluated
+    struct Input
+    {
+        std::string name;
+        bool set = false;
+        double value = 0;
+    };
+
+    struct Line
+    {
+        std::string text;        // trimmed line as echoed
+        bool definition = false; // "name = expression"
+        bool failed = false;
+        double value = 0;
+        std::string exact; // digits of an exact integer result
+        std::string error;
+        std::vector<Input> inputs;
+    };
+
+    std::string source;
+    std::vector<Line> lines;
+};
+
+#endif // SESSION_H
@@ -0,0 +1,39 @@
+#ifndef SIMPLE_STACK_H
+#define SIMPLE_STACK_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// --------------------------------------
+// LIFO stack used in place of the call stack by the parser and the tree
+// passes, so nesting depth is limited only by memory. clear() keeps the
+// storage, so a stack reused for every expression stops allocating once it
+// has grown to the deepest one.
+// --------------------------------------
+template <typename T>
+class SimpleStack
+{
+public:
+    void push(const T &x) { items.push_back(x); }
+    void push(T &&x) { items.push_back(std::move(x)); }
+
+    T pop()
+    {
+        T x = std::move(items.back());
+        items.pop_back();
+        return x;
+    }
+
+    T &top() { return items.back(); }
+    const T &top() const { return items.back(); }
+
+    bool empty() const { return items.empty(); }
+    size_t size() const { return items.size(); }
+    void clear() { items.clear(); }
+
+private:
+    std::vector<T> items;
+};
+
+#endif // SIMPLE_STACK_H
@@ -0,0 +1,128 @@
+#include "stats.h"
+
+#ifndef CALC_NO_STATS
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace stats
+{
+    bool enabled = false;
+
+    namespace
+    {
+        // Per-thread blocks stay alive after their thread exits
+        std::mutex registryMutex;
+        std::vector<std::unique_ptr<ThreadStats>> registry;
+
+        std::chrono::steady_clock::time_point startTime;
+        uint64_t startTicks = 0;
+
+        const char *phaseNames[PhaseCount] = {
+            "read_file", "split_sessions", "lex", "parse", "compile", "evaluate", "output"};
+        const char *counterNames[CounterCount] = {
+            "sessions", "lines", "tokens", "nodes",
+            "parser_error", "undefined_variable", "division_by_zero", "other"};
+
+        // Peak resident set size in kilobytes
+        long peakMemoryKb()
+        {
+#ifdef _WIN32
+            PROCESS_MEMORY_COUNTERS pmc;
+            if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+                return static_cast<long>(pmc.PeakWorkingSetSize / 1024);
+            return 0;
+#else
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            return usage.ru_maxrss;
+#endif
+        }
+    }
+
+    ThreadStats &registerThread()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::make_unique<ThreadStats>());
+        current = registry.back().get();
+        return *current;
+    }
+
+    void enable()
+    {
+        startTime = std::chrono::steady_clock::now();
+        startTicks = now();
+        enabled = true;
+    }
+
+    void countError(const Diagnostic &error)
+    {
+        if (!enabled)
+            return;
+        if (error.parserError())
+            count(ParserErrors);
+        else if (error.code == ErrorCode::UndefinedVariable)
+            count(UndefinedVariables);
+        else if (error.code == ErrorCode::DivisionByZero)
+            count(DivisionByZero);
+        else
+            count(OtherErrors);
+    }
+
+    void report(std::FILE *out)
+    {
+        if (!enabled)
+            return;
+
+        // Convert ticks to nanoseconds using the whole run as reference
+        double wallNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+        uint64_t elapsedTicks = now() - startTicks;
+        double nsPerTick = elapsedTicks ? wallNs / static_cast<double>(elapsedTicks) : 1.0;
+
+        ThreadStats total;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (const auto &t : registry)
+            {
+                for (int p = 0; p < PhaseCount; p++)
+                    total.ticks[p] += t->ticks[p];
+                for (int c = 0; c < CounterCount; c++)
+                    total.counters[c] += t->counters[c];
+            }
+        }
+        // The parser timer includes the lexer calls it makes
+        total.ticks[Parse] -= total.ticks[Lex] < total.ticks[Parse] ? total.ticks[Lex] : total.ticks[Parse];
+
+        std::fprintf(out, "{\"wall_ms\": %.3f, \"phases_ms\": {", wallNs / 1e6);
+        for (int p = 0; p < PhaseCount; p++)
+        {
+            std::fprintf(out, "%s\"%s\": %.3f", p ? ", " : "", phaseNames[p],
+                         static_cast<double>(total.ticks[p]) * nsPerTick / 1e6);
+        }
+        std::fprintf(out, "}, \"counts\": {");
+        for (int c = Sessions; c <= Nodes; c++)
+        {
+            std::fprintf(out, "%s\"%s\": %llu", c ? ", " : "", counterNames[c],
+                         static_cast<unsigned long long>(total.counters[c]));
+        }
+        std::fprintf(out, "}, \"errors\": {");
+        for (int c = ParserErrors; c < CounterCount; c++)
+        {
+            std::fprintf(out, "%s\"%s\": %llu", c != ParserErrors ? ", " : "", counterNames[c],
+                         static_cast<unsigned long long>(total.counters[c]));
+        }
+        std::fprintf(out, "}, \"peak_memory_kb\": %ld}\n", peakMemoryKb());
+    }
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstdint>
+#include <cstdio>
+
+#include "diagnostic.h"
+
+// Per-phase timing and counters, switched on at run time with --stats.
+// Build with -DCALC_NO_STATS to compile every probe out entirely.
+
+#ifndef CALC_NO_STATS
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+namespace stats
+{
+    enum Phase : uint8_t
+    {
+        ReadFile,
+        SplitSessions,
+        Lex,
+        Parse, // measured around the parser, the report subtracts Lex
+        Compile,
+        Evaluate,
+        Output,
+        PhaseCount
+    };
+
+    enum Counter : uint8_t
+    {
+        Sessions,
+        Lines,
+        Tokens,
+        Nodes,
+        ParserErrors,
+        UndefinedVariables,
+        DivisionByZero,
+        OtherErrors,
+        CounterCount
+    };
+
+#ifndef CALC_NO_STATS
+
+    // Set once by enable(); probes do nothing while it is false
+    extern bool enabled;
+
+    // Counters of one thread; summed over all threads by report()
+    struct ThreadStats
+    {
+        uint64_t ticks[PhaseCount] = {};
+        uint64_t counters[CounterCount] = {};
+        uint32_t sample = 0;
+    };
+
+    ThreadStats &registerThread();
+
+    inline thread_local ThreadStats *current = nullptr;
+
+    inline ThreadStats &local()
+    {
+        return current ? *current : registerThread();
+    }
+
+    inline uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    inline void count(Counter c, uint64_t n = 1)
+    {
+        if (enabled)
+            local().counters[c] += n;
+    }
+
+    // Adds the lifetime of the object to a phase
+    class Timer
+    {
+    public:
+        explicit Timer(Phase p) : phase(p), start(enabled ? now() : 0) {}
+        ~Timer()
+        {
+            if (enabled)
+                local().ticks[phase] += now() - start;
+        }
+
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+    private:
+        Phase phase;
+        uint64_t start;
+    };
+
+    // Times one call in SampleRate and scales it up; for probes on paths too
+    // hot to read the clock every time (the lexer runs once per token)
+    class SampledTimer
+    {
+    public:
+        static constexpr uint32_t SampleRate = 16;
+
+        explicit SampledTimer(Phase p)
+            : phase(p), start(enabled && (++local().sample & (SampleRate - 1)) == 0 ? now() : 0) {}
+        ~SampledTimer()
+        {
+            if (start)
+                local().ticks[phase] += (now() - start) * SampleRate;
+        }
+
+        SampledTimer(const SampledTimer &) = delete;
+        SampledTimer &operator=(const SampledTimer &) = delete;
+
+    private:
+        Phase phase;
+        uint64_t start;
+    };
+
+    void enable();
+
+    // Count an error under its kind
+    void countError(const Diagnostic &error);
+
+    // Write the JSON summary (call after all worker threads have finished)
+    void report(std::FILE *out);
+
+#else
+
+    constexpr bool enabled = false;
+
+    inline void count(Counter, uint64_t = 1) {}
+
+    class Timer
+    {
+    public:
+        explicit Timer(Phase) {}
+    };
+
+    class SampledTimer
+    {
+    public:
+        explicit SampledTimer(Phase) {}
+    };
+
+    inline void enable() {}
+    inline void countError(const Diagnostic &) {}
+    inline void report(std::FILE *) {}
+
+#endif
+}
+
+#endif // STATS_H
@@ -0,0 +1,291 @@
+#include "stream.h"
+#include "outputBuffer.h"
+#include "ringBuffer.h"
+#include "utils.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Sessions buffered between two stages of one lane
+    const size_t RingCapacity = 16;
+
+    struct StreamLine
+    {
+        std::string_view text;   // trimmed line as echoed
+        std::string_view target; // variable defined by the line, if any
+        bool definition = false;
+        Program program;
+        std::string exact; // digits of an exact integer result (--exact)
+
+        // Filled by the evaluate stage
+        bool failed = false;
+        double value = 0;
+        std::string error;
+    };
+
+    struct StreamSession
+    {
+        int number = 0; // "Session N"
+        std::string text;
+        SymbolTable symbols;
+        std::vector<StreamLine> lines;
+    };
+
+    using Item = std::unique_ptr<StreamSession>;
+    using Ring = SpscRing<Item>;
+
+    void push(Ring &ring, Item &item)
+    {
+        Backoff backoff;
+        while (!ring.tryPush(item))
+            backoff.pause();
+    }
+
+    // False once the ring is closed and drained
+    bool pop(Ring &ring, Item &item)
+    {
+        Backoff backoff;
+        while (!ring.tryPop(item))
+        {
+            if (ring.closed())
+                return ring.tryPop(item);
+            backoff.pause();
+        }
+        return true;
+    }
+
+    // Lex, parse and compile every line (the same line rules as runSession)
+    void parseStage(Ring &in, Ring &out, const SessionOptions &options)
+    {
+        AstArena arena;
+        Item item;
+        while (pop(in, item))
+        {
+            arena.clear();
+            size_t linePos = 0;
+            std::string_view line;
+            while (nextLine(item->text, linePos, line))
+            {
+                std::string_view cleaned = trim(line);
+                if (cleaned == "" || cleaned == "\r" || cleaned == "\n")
+                    continue;
+
+                StreamLine l;
+                l.text = cleaned;
+                std::string_view expr = cleaned;
+                size_t pos = cleaned.find('=');
+                if (pos != std::string_view::npos)
+                {
+                    l.definition = true;
+                    l.target = trim(cleaned.substr(0, pos));
+                    expr = trim(cleaned.substr(pos + 1));
+                }
+                l.program = compileExpression(expr, arena, item->symbols, options, l.exact);
+                item->lines.push_back(std::move(l));
+            }
+            push(out, item);
+        }
+        out.close();
+    }
+
+    void evaluateStage(Ring &in, Ring &out)
+    {
+        Item item;
+        while (pop(in, item))
+        {
+            VirtualMachine vm(item->symbols);
+            for (StreamLine &l : item->lines)
+            {
+                Expected<double> result = vm.run(l.program);
+                if (result)
+                {
+                    l.value = result.value();
+                    if (l.definition)
+                        item->symbols.set(l.target, l.value);
+                }
+                else
+                {
+                    l.failed = true;
+                    l.error = result.error().message();
+                }
+            }
+            push(out, item);
+        }
+        out.close();
+    }
+
+    // Same block runSession() appends
+    void format(const StreamSession &session, OutputBuffer &out)
+    {
+        out.append("Session ");
+        out.appendInt(session.number);
+        out.append(":\n\n");
+        for (const StreamLine &l : session.lines)
+        {
+            out.append(l.text);
+            out.append('\n');
+        }
+        out.append('\n');
+
+        bool answered = false;
+        for (const StreamLine &l : session.lines)
+        {
+            if (l.failed)
+            {
+                out.append("Error: ");
+                out.append(l.error);
+                out.append('\n');
+            }
+            else if (!l.definition)
+            {
+                out.append("Answer: ");
+                if (!l.exact.empty())
+                    out.append(l.exact);
+                else
+                    out.appendNumber(l.value);
+                out.append('\n');
+            }
+            else
+            {
+                continue;
+            }
+            answered = true;
+        }
+        if (!answered)
+            out.append("Answer: (no expression)\n");
+
+        static const std::string separator(50, '-');
+        out.append(separator);
+        out.append("\n\n");
+    }
+
+    // Sessions arrive round robin over the lanes, so taking the lanes in
+    // turn yields them in input order. Output is flushed whenever the next
+    // session is not ready yet.
+    void formatStage(std::vector<std::unique_ptr<Ring>> &lanes)
+    {
+        OutputBuffer out(stdout);
+        Item item;
+        for (size_t next = 0;; next = (next + 1) % lanes.size())
+        {
+            Ring &ring = *lanes[next];
+            if (!ring.tryPop(item))
+            {
+                out.flush();
+                if (!pop(ring, item))
+                    break;
+            }
+            format(*item, out);
+            item.reset();
+        }
+    }
+
+    // Cuts the input into sessions as complete lines arrive; only the
+    // session being read is buffered
+    class StreamSplitter
+    {
+    public:
+        explicit StreamSplitter(std::vector<std::unique_ptr<Ring>> &rings) : lanes(rings) {}
+
+        void feed(const char *data, size_t size)
+        {
+            buffer.append(data, size);
+
+            size_t end;
+            while ((end = buffer.find('\n', lineStart)) != std::string::npos)
+            {
+                std::string_view line(buffer.data() + lineStart, end - lineStart);
+                if (trim(line) == "----")
+                {
+                    emit(std::string_view(buffer).substr(0, lineStart));
+                    buffer.erase(0, end + 1);
+                    lineStart = 0;
+                }
+                else
+                {
+                    lineStart = end + 1;
+                }
+            }
+        }
+
+        // The rest of the input, split exactly as a whole file would be
+        void finish()
+        {
+            SessionSplitter sessions(buffer);
+            std::string_view session;
+            while (sessions.next(session))
+                emit(session);
+            for (auto &ring : lanes)
+                ring->close();
+        }
+
+    private:
+        std::vector<std::unique_ptr<Ring>> &lanes;
+        std::string buffer;  // the session being read
+        size_t lineStart = 0; // first line not yet known to be complete
+        int sessions = 0;
+
+        void emit(std::string_view session)
+        {
+            if (trim(session).empty())
+                return;
+            Item item = std::make_unique<StreamSession>();
+            item->number = sessions + 1;
+            item->text.assign(session.data(), session.size());
+            push(*lanes[sessions % lanes.size()], item);
+            sessions++;
+        }
+    };
+
+    long readInput(char *buffer, size_t size)
+    {
+#ifdef _WIN32
+        return _read(0, buffer, static_cast<unsigned>(size));
+#else
+        return static_cast<long>(::read(0, buffer, size));
+#endif
+    }
+}
+
+int runStream(size_t laneCount, const SessionOptions &options)
+{
+    std::vector<std::unique_ptr<Ring>> toParse, toEvaluate, toFormat;
+    for (size_t i = 0; i < laneCount; i++)
+    {
+        toParse.push_back(std::make_unique<Ring>(RingCapacity));
+        toEvaluate.push_back(std::make_unique<Ring>(RingCapacity));
+        toFormat.push_back(std::make_unique<Ring>(RingCapacity));
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < laneCount; i++)
+    {
+        threads.emplace_back(parseStage, std::ref(*toParse[i]), std::ref(*toEvaluate[i]), std::cref(options));
+        threads.emplace_back(evaluateStage, std::ref(*toEvaluate[i]), std::ref(*toFormat[i]));
+    }
+    threads.emplace_back(formatStage, std::ref(toFormat));
+
+    // Split on this thread; read() returns whatever is available, so a
+    // slow producer's sessions are processed as they come
+    StreamSplitter splitter(toParse);
+    char buffer[64 * 1024];
+    long n;
+    while ((n = readInput(buffer, sizeof(buffer))) > 0)
+        splitter.feed(buffer, static_cast<size_t>(n));
+    splitter.finish();
+
+    for (std::thread &t : threads)
+        t.join();
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <cstddef>
+
+#include "session.h"
+
+// Entry point for `calc -`: read sessions from stdin as they arrive and
+// print each session's output as soon as it and every earlier session are
+// done. Work flows through pipelined stages (split, lex/parse, evaluate,
+// format) connected by bounded rings, so memory stays bounded however long
+// the stream is (apart from the size of a single session). 'lanes' parse
+// and evaluate threads each handle every lanes-th session. Always uses the
+// bytecode VM (with the folding, --cse and --exact of 'options'); the
+// expression cache and JIT are not used.
+int runStream(size_t lanes, const SessionOptions &options);
+
+#endif // STREAM_H
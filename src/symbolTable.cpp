@@ -1,15 +1,22 @@
 #include "symbolTable.h"
+#include "memoryTracker.h"
 
-void SymbolTable::set(const std::string &name, double value)
+void SymbolTable::set(SymbolId id, double value)
 {
-    table[name] = value;
+    memtrack::Tag tag(memtrack::Symbols);
+    if (id >= values.size())
+    {
+        values.resize(id + 1);
+        assigned.resize(id / 64 + 1);
+    }
+    values[id] = value;
+    assigned[id / 64] |= uint64_t(1) << (id % 64);
 }
 
-bool SymbolTable::get(const std::string &name, double &outValue) const
+bool SymbolTable::get(std::string_view name, double &outValue) const
 {
-    auto it = table.find(name);
-    if (it == table.end())
+    SymbolId id = names.find(name);
+    if (id == Interner::NotFound)
         return false;
-    outValue = it->second;
-    return true;
-}
\ No newline at end of file
+    return get(id, outValue);
+}
@@ -1,20 +1,57 @@
 #ifndef SYMBOL_TABLE_H
 #define SYMBOL_TABLE_H
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
-#include <map>
+#include <string_view>
+#include <vector>
 
+#include "interner.h"
+
+// Dense id of an interned variable name
+using SymbolId = uint32_t;
+
+// Variables of one session. Names are interned to dense ids when they are
+// first seen (while parsing or assigning) and values live in a flat array
+// indexed by id, with a bitmap telling which ones have been assigned.
 class SymbolTable
 {
 public:
+    // Id for a variable name, created on first use
+    SymbolId intern(std::string_view name) { return names.intern(name); }
+
+    std::string_view name(SymbolId id) const { return names.name(id); }
+
+    // Number of interned names
+    size_t size() const { return names.size(); }
+
     // Store or update a variable
-    void set(const std::string &name, double value);
+    void set(SymbolId id, double value);
+    void set(std::string_view name, double value) { set(intern(name), value); }
 
     // Retrieve variable value, returns true if found
-    bool get(const std::string &name, double &outValue) const;
+    bool get(SymbolId id, double &outValue) const
+    {
+        if (!isSet(id))
+            return false;
+        outValue = values[id];
+        return true;
+    }
+    bool get(std::string_view name, double &outValue) const;
+
+    // Forget every value but keep the interned names (and their ids)
+    void reset() { std::fill(assigned.begin(), assigned.end(), 0); }
+
+    bool isSet(SymbolId id) const
+    {
+        return id < values.size() && (assigned[id / 64] >> (id % 64) & 1) != 0;
+    }
 
 private:
-    std::map<std::string, double> table;
+    Interner names;
+    std::vector<double> values;
+    std::vector<uint64_t> assigned; // presence bitmap
 };
 
 #endif // SYMBOL_TABLE_H
@@ -0,0 +1,130 @@
+#include "threadPool.h"
+
+namespace
+{
+    // Index of the worker running on this thread, or -1 for outside threads
+    thread_local long currentWorker = -1;
+    thread_local const void *currentPool = nullptr;
+}
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = 1;
+
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back([this, i]
+                             { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeWorkers.notify_all();
+    for (auto &t : workers)
+    {
+        t.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    // Workers push onto their own deque, outside threads round-robin
+    size_t index;
+    if (currentPool == this && currentWorker >= 0)
+        index = static_cast<size_t>(currentWorker);
+    else
+        index = nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+    // 'queued' changes under the deque's lock together with the deque, so
+    // a worker that sees it nonzero always finds a task
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+        queued.fetch_add(1);
+    }
+    {
+        // A worker checks 'queued' under sleepMutex before it sleeps; taking
+        // the lock here keeps the wakeup from falling in between
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeWorkers.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    allDone.wait(lock, [this]
+                 { return pending.load() == 0; });
+}
+
+// Newest task from our own deque (LIFO keeps caches warm)
+bool ThreadPool::popLocal(size_t index, std::function<void()> &task)
+{
+    WorkQueue &q = *queues[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty())
+        return false;
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    queued.fetch_sub(1);
+    return true;
+}
+
+// Oldest task from another worker's deque
+bool ThreadPool::steal(size_t index, std::function<void()> &task)
+{
+    for (size_t k = 1; k < queues.size(); k++)
+    {
+        WorkQueue &q = *queues[(index + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty())
+        {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index)
+{
+    currentWorker = static_cast<long>(index);
+    currentPool = this;
+
+    std::function<void()> task;
+    while (true)
+    {
+        if (popLocal(index, task) || steal(index, task))
+        {
+            task();
+            task = nullptr;
+
+            if (pending.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                allDone.notify_all();
+            }
+            continue;
+        }
+
+        // Nothing to run: sleep until new work arrives
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeWorkers.wait(lock, [this]
+                         { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0)
+            return;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing thread pool.
+// Each worker owns a deque: it pops its own work from the back and, when
+// empty, steals from the front of the other workers' deques.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Queue a task. Tasks must not throw.
+    void submit(std::function<void()> task);
+
+    // Block until every submitted task has finished
+    void wait();
+
+    size_t size() const { return workers.size(); }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<size_t> pending{0}; // submitted but not finished
+    std::atomic<size_t> queued{0};  // submitted but not started
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeWorkers;
+    std::condition_variable allDone;
+    bool stopping = false;
+
+    void workerLoop(size_t index);
+    bool popLocal(size_t index, std::function<void()> &task);
+    bool steal(size_t index, std::function<void()> &task);
+};
+
+#endif // THREAD_POOL_H
@@ -1,45 +1,84 @@
 #include "utils.h"
+#include "memoryTracker.h"
 #include <fstream>
 #include <sstream>
 #include <algorithm>
-#include <iomanip>
+#include <charconv>
+#include <cstring>
 
 // Trim whitespace from both ends of a string
-std::string trim(const std::string &s)
+std::string_view trim(std::string_view s)
 {
     size_t left = s.find_first_not_of(" \t\n\r");
-    if (left == std::string::npos)
-        return "";
+    if (left == std::string_view::npos)
+        return std::string_view();
     size_t right = s.find_last_not_of(" \t\n\r");
     return s.substr(left, right - left + 1);
 }
 
-// Split file content into sessions using "----"
-std::vector<std::string> splitSessions(const std::string &fileContent)
+// Read the next line of text, advancing pos past its '\n'
+bool nextLine(std::string_view text, size_t &pos, std::string_view &line)
 {
-    std::vector<std::string> sessions;
-    std::stringstream ss(fileContent);
-    std::string line;
-    std::string current;
+    if (pos >= text.size())
+        return false;
+
+    size_t end = text.find('\n', pos);
+    if (end == std::string_view::npos)
+        end = text.size();
+
+    line = text.substr(pos, end - pos);
+    pos = (end < text.size()) ? end + 1 : end;
+    return true;
+}
+
+SessionSplitter::SessionSplitter(std::string_view content)
+    : text(content), pos(0) {}
 
-    while (std::getline(ss, line))
+// A session is every line up to the next "----" line (or end of text)
+bool SessionSplitter::next(std::string_view &session)
+{
+    while (pos < text.size())
     {
-        if (trim(line) == "----")
+        size_t start = pos;
+        size_t end = pos;
+        std::string_view line;
+
+        while (true)
         {
-            if (!current.empty())
+            size_t lineStart = pos;
+            if (!nextLine(text, pos, line))
+            {
+                end = text.size();
+                break;
+            }
+            if (trim(line) == "----")
             {
-                sessions.push_back(trim(current));
-                current.clear();
+                end = lineStart;
+                break;
             }
         }
-        else
+
+        // Consecutive separators produce no session
+        if (end > start)
         {
-            current += line + "\n";
+            session = text.substr(start, end - start);
+            return true;
         }
     }
-    if (!current.empty())
+    return false;
+}
+
+// Split file content into sessions using "----"
+std::vector<std::string_view> splitSessions(std::string_view fileContent)
+{
+    memtrack::Tag tag(memtrack::Input);
+    std::vector<std::string_view> sessions;
+    SessionSplitter splitter(fileContent);
+    std::string_view session;
+
+    while (splitter.next(session))
     {
-        sessions.push_back(current);
+        sessions.push_back(session);
     }
     return sessions;
 }
@@ -47,6 +86,7 @@ std::vector<std::string> splitSessions(const std::string &fileContent)
 // Read entire file content into a string
 std::string readFile(const std::string &filename)
 {
+    memtrack::Tag tag(memtrack::Input);
     std::ifstream f(filename);
     if (!f.is_open())
         return "";
@@ -56,23 +96,25 @@ std::string readFile(const std::string &filename)
     return buffer.str();
 }
 
-// Format double cleanly (removing trailing zeros after decimal point)
-std::string formatDouble(double value)
+// Format double cleanly (removing trailing zeros after decimal point).
+// Same text as std::fixed with setprecision(10), without a stream.
+size_t formatDouble(double value, char *out)
 {
-    std::ostringstream out;
-    out << std::fixed << std::setprecision(10) << value;
-    std::string s = out.str();
+    char *end = std::to_chars(out, out + FormatDoubleMax, value, std::chars_format::fixed, 10).ptr;
 
-    // Remove trailing zeros
-    while (s.find('.') != std::string::npos && s.back() == '0')
+    // Remove trailing zeros, then a trailing decimal point
+    if (std::memchr(out, '.', end - out) != nullptr)
     {
-        s.pop_back();
+        while (end[-1] == '0')
+            end--;
+        if (end[-1] == '.')
+            end--;
     }
+    return static_cast<size_t>(end - out);
+}
 
-    // Remove trailing decimal point
-    if (!s.empty() && s.back() == '.')
-    {
-        s.pop_back();
-    }
-    return s;
-}
\ No newline at end of file
+std::string formatDouble(double value)
+{
+    char buffer[FormatDoubleMax];
+    return std::string(buffer, formatDouble(value, buffer));
+}
@@ -2,16 +2,43 @@
 #define UTILS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 
-std::string trim(const std::string &s);
+std::string_view trim(std::string_view s);
 
-// Split file content into sessions using "----
-std::vector<std::string> splitSessions(const std::string &fileContent);
+// Read the next line of 'text' starting at 'pos' (without the '\n').
+// Returns false once the end of the text is reached.
+bool nextLine(std::string_view text, size_t &pos, std::string_view &line);
+
+// Walks file content session by session using "----" separator lines.
+// Sessions are returned as slices of the original text, nothing is copied.
+class SessionSplitter
+{
+public:
+    explicit SessionSplitter(std::string_view content);
+
+    // Fetch the next session, returns false when there are no more
+    bool next(std::string_view &session);
+
+private:
+    std::string_view text;
+    size_t pos;
+};
+
+// Split file content into sessions using "----"
+std::vector<std::string_view> splitSessions(std::string_view fileContent);
 
 // Read entire file content into a string
 std::string readFile(const std::string &filename);
 
+// Longest text formatDouble can produce: sign, 309 digits, '.', 10 decimals
+constexpr size_t FormatDoubleMax = 330;
+
+// Decimal text of a value with at most 10 decimals and no trailing zeros
 std::string formatDouble(double value);
 
-#endif // UTILS_H
\ No newline at end of file
+// Same, written to 'out' (FormatDoubleMax chars); returns the length
+size_t formatDouble(double value, char *out);
+
+#endif // UTILS_H
@@ -0,0 +1,154 @@
+#include "watch.h"
+#include "mappedFile.h"
+#include "outputBuffer.h"
+#include "utils.h"
+
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Evaluate the file again, reusing what is still valid from 'states',
+    // and print the complete output
+    void refresh(const std::string &filename, std::vector<SessionState> &states,
+                 const SessionOptions &options)
+    {
+        MappedFile file(filename);
+        OutputBuffer out(stdout);
+        if (!file.isOpen())
+        {
+            out.append("Error: Could not read file or file is empty.\n");
+            states.clear();
+            return;
+        }
+
+        std::vector<std::string_view> sessions;
+        SessionSplitter splitter(file.view());
+        std::string_view session;
+        while (splitter.next(session))
+        {
+            if (!trim(session).empty())
+                sessions.push_back(session);
+        }
+
+        // Sessions with unchanged text keep their state as is
+        std::vector<SessionState> previous = std::move(states);
+        std::unordered_multimap<std::string_view, size_t> previousByText;
+        for (size_t i = 0; i < previous.size(); i++)
+        {
+            previousByText.emplace(previous[i].text(), i);
+        }
+
+        const size_t none = static_cast<size_t>(-1);
+        std::vector<size_t> match(sessions.size(), none);
+        std::vector<bool> taken(previous.size(), false);
+        for (size_t i = 0; i < sessions.size(); i++)
+        {
+            auto range = previousByText.equal_range(sessions[i]);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (!taken[it->second])
+                {
+                    match[i] = it->second;
+                    taken[it->second] = true;
+                    break;
+                }
+            }
+        }
+
+        // Edited sessions start from the state at the same position, so
+        // that their unchanged lines are reused
+        states.resize(sessions.size());
+        size_t changedSessions = 0;
+        size_t evaluatedLines = 0;
+        for (size_t i = 0; i < sessions.size(); i++)
+        {
+            if (match[i] != none)
+            {
+                states[i] = std::move(previous[match[i]]);
+                continue;
+            }
+            if (i < previous.size() && !taken[i])
+            {
+                states[i] = std::move(previous[i]);
+                taken[i] = true;
+            }
+            evaluatedLines += states[i].update(sessions[i], options);
+            changedSessions++;
+        }
+
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            states[i].write(static_cast<int>(i) + 1, out);
+        }
+        out.flush();
+
+        std::cerr << "watch: evaluated " << changedSessions << " of " << sessions.size()
+                  << " sessions (" << evaluatedLines << " lines)\n";
+    }
+}
+
+int runWatch(const std::string &filename, const SessionOptions &options)
+{
+#ifdef __linux__
+    // Watch the directory rather than the file: editors often save by
+    // writing a new file and renaming it over the old one
+    size_t slash = filename.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : filename.substr(0, slash + 1);
+    std::string name = slash == std::string::npos ? filename : filename.substr(slash + 1);
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        std::cerr << "Error: Could not watch " << filename << "\n";
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+
+    std::vector<SessionState> states;
+    refresh(filename, states, options);
+
+    alignas(inotify_event) char events[4096];
+    while (true)
+    {
+        bool changed = false;
+        ssize_t n = read(fd, events, sizeof(events));
+        if (n <= 0)
+            break;
+
+        // Several events usually arrive for one save; collect everything
+        // that comes in shortly after the first one
+        while (n > 0)
+        {
+            for (char *p = events; p < events + n;)
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+                if (event->len > 0 && name == event->name)
+                    changed = true;
+                p += sizeof(inotify_event) + event->len;
+            }
+
+            pollfd pending = {fd, POLLIN, 0};
+            n = poll(&pending, 1, 50) > 0 ? read(fd, events, sizeof(events)) : 0;
+        }
+
+        if (changed)
+            refresh(filename, states, options);
+    }
+
+    close(fd);
+    return 1;
+#else
+    (void)options;
+    std::cerr << "Error: --watch is not supported on this platform\n";
+    return 1;
+#endif
+}
@@ -0,0 +1,15 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <string>
+
+#include "session.h"
+
+// Entry point for `calc --watch`: print the output for 'filename', then
+// wait for the file to change and print it again after every change.
+// Sessions whose text is unchanged are not evaluated again, and within an
+// edited session only the lines affected by the edit are (see SessionState).
+// Runs until interrupted; Linux only (inotify).
+int runWatch(const std::string &filename, const SessionOptions &options);
+
+#endif // WATCH_H